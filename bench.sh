@@ -0,0 +1,58 @@
+#!/bin/bash
+#
+# Compares the filter builtins with the coreutils and grep binaries.
+#
+# Every command is run through ./shell twice: once as typed, which uses the builtin, and
+# once behind env, which execs the real binary. Output goes to a file rather than
+# /dev/null since GNU grep stops early when it sees /dev/null. Each case reports the
+# best wall time of BENCH_RUNS runs and checks both outputs match.
+#
+# Usage: ./bench.sh [lines]    (default 4000000 lines, about 200 MB)
+
+lines=${1:-4000000}
+runs=${BENCH_RUNS:-5}
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+seq "$lines" | awk '{ print $1, "lorem ipsum dolor sit amet", ($1 * 7919) % 100003, "consectetur" }' > "$dir/data"
+echo "input: $lines lines, $(du -h "$dir/data" | cut -f1), best of $runs runs, cpu: $(nproc)"
+
+# Prints the best wall time in ms of running the command line through the shell.
+best() {
+	local bestTime=
+	for ((i = 0 ; i < runs ; ++i)) ; do
+		local start=$(date +%s%N)
+		echo "$1" | ./shell > /dev/null 2>&1
+		local elapsed=$(( ($(date +%s%N) - start) / 1000 ))
+		if [ -z "$bestTime" ] || [ "$elapsed" -lt "$bestTime" ] ; then
+			bestTime=$elapsed
+		fi
+	done
+	printf '%d.%03d' $((bestTime / 1000)) $((bestTime % 1000))
+}
+
+# Runs one case with the builtin and with the binary. "@" in the template is replaced
+# by the data file, "%" by nothing or env.
+compare() {
+	local builtin=${1//@/$dir/data}
+	builtin=${builtin//%/}
+	local binary=${1//@/$dir/data}
+	binary=${binary//%/env }
+	local builtinTime=$(best "$builtin > $dir/out.builtin")
+	local binaryTime=$(best "$binary > $dir/out.binary")
+	local same=same
+	cmp -s "$dir/out.builtin" "$dir/out.binary" || same=DIFFERENT
+	printf '%-34s %10s %10s %8s  %s\n' "${1//%/}" "$builtinTime" "$binaryTime" \
+		"$(awk -v a="$builtinTime" -v b="$binaryTime" 'BEGIN { printf "%.2f", b / a }')" "$same"
+}
+
+printf '%-34s %10s %10s %8s\n' "command (@ = input)" "builtin ms" "binary ms" "speedup"
+compare "%wc -l @"
+compare "%wc @"
+compare "%grep -F -c 99999 @"
+compare "%grep -F 99999 @"
+compare "%head -n 1000000 @"
+compare "%tail -n 1000000 @"
+compare "cat @ | %wc -l"
+compare "cat @ | %grep -F -c 99999"
+compare "cat @ | %tail -n 1000000"
@@ -0,0 +1,682 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  filters.cpp
+ *
+ *    Description:  Source for Filters object.
+ *
+ *        Version:  1.0
+ *        Created:  19/10/26 10:02:17
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Michael Tierney (MT), tiernemi@tcd.ie
+ *
+ * =====================================================================================
+ */
+
+#include "filters.hpp"
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <algorithm>
+#include <deque>
+#include <sys/stat.h>
+#include <iostream>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define FILTERS_HAVE_X86 1
+#endif
+
+// Size of each buffered read. //
+static const size_t readSize = 1 << 20 ;
+
+/*
+ * =====================================================================================
+ *  Kernels. Each has a scalar version and, on x86-64, SSE2 and AVX2 versions. The
+ *  version used is chosen once at runtime from the cpu features, or by useKernel.
+ * =====================================================================================
+ */
+
+typedef size_t (*CountKernel)(const char *, size_t) ;
+typedef const char * (*FindKernel)(const char *, size_t, const char *, size_t) ;
+
+static size_t countNewlinesScalar(const char * buf, size_t len) {
+	size_t count = 0 ;
+	for (size_t i = 0 ; i < len ; ++i) {
+		count += (buf[i] == '\n') ;
+	}
+	return count ;
+}
+
+static const char * findFixedScalar(const char * buf, size_t len, const char * pat, size_t patLen) {
+	return static_cast<const char *>(memmem(buf, len, pat, patLen)) ;
+}
+
+#ifdef FILTERS_HAVE_X86
+
+static size_t countNewlinesSSE2(const char * buf, size_t len) {
+	const __m128i newline = _mm_set1_epi8('\n') ;
+	const __m128i zero = _mm_setzero_si128() ;
+	size_t count = 0 ;
+	size_t i = 0 ;
+	while (i + 16 <= len) {
+		// Byte counters hold at most 255 before they must be summed. //
+		__m128i acc = _mm_setzero_si128() ;
+		for (int k = 0 ; k < 255 && i + 16 <= len ; ++k, i += 16) {
+			__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + i)) ;
+			acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(block, newline)) ;
+		}
+		__m128i sums = _mm_sad_epu8(acc, zero) ;
+		count += _mm_cvtsi128_si64(sums) + _mm_extract_epi16(sums, 4) ;
+	}
+	return count + countNewlinesScalar(buf + i, len - i) ;
+}
+
+__attribute__((target("avx2")))
+static size_t countNewlinesAVX2(const char * buf, size_t len) {
+	const __m256i newline = _mm256_set1_epi8('\n') ;
+	const __m256i zero = _mm256_setzero_si256() ;
+	size_t count = 0 ;
+	size_t i = 0 ;
+	while (i + 32 <= len) {
+		__m256i acc = _mm256_setzero_si256() ;
+		for (int k = 0 ; k < 255 && i + 32 <= len ; ++k, i += 32) {
+			__m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(buf + i)) ;
+			acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(block, newline)) ;
+		}
+		__m256i sums = _mm256_sad_epu8(acc, zero) ;
+		count += _mm256_extract_epi64(sums, 0) + _mm256_extract_epi64(sums, 1) +
+			_mm256_extract_epi64(sums, 2) + _mm256_extract_epi64(sums, 3) ;
+	}
+	return count + countNewlinesScalar(buf + i, len - i) ;
+}
+
+// Compares the first and last byte of the pattern at every offset of a block and //
+// only checks the middle of the pattern for candidate offsets. //
+static const char * findFixedSSE2(const char * buf, size_t len, const char * pat, size_t patLen) {
+	const __m128i first = _mm_set1_epi8(pat[0]) ;
+	const __m128i last = _mm_set1_epi8(pat[patLen-1]) ;
+	size_t i = 0 ;
+	for ( ; i + patLen - 1 + 16 <= len ; i += 16) {
+		__m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + i)) ;
+		__m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i *>(buf + i + patLen - 1)) ;
+		unsigned int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(blockFirst, first),
+					_mm_cmpeq_epi8(blockLast, last))) ;
+		while (mask != 0) {
+			unsigned int bit = __builtin_ctz(mask) ;
+			if (memcmp(buf + i + bit + 1, pat + 1, patLen - 2) == 0) {
+				return buf + i + bit ;
+			}
+			mask &= mask - 1 ;
+		}
+	}
+	return findFixedScalar(buf + i, len - i, pat, patLen) ;
+}
+
+__attribute__((target("avx2")))
+static const char * findFixedAVX2(const char * buf, size_t len, const char * pat, size_t patLen) {
+	const __m256i first = _mm256_set1_epi8(pat[0]) ;
+	const __m256i last = _mm256_set1_epi8(pat[patLen-1]) ;
+	size_t i = 0 ;
+	for ( ; i + patLen - 1 + 32 <= len ; i += 32) {
+		__m256i blockFirst = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(buf + i)) ;
+		__m256i blockLast = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(buf + i + patLen - 1)) ;
+		unsigned int mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(blockFirst, first),
+					_mm256_cmpeq_epi8(blockLast, last))) ;
+		while (mask != 0) {
+			unsigned int bit = __builtin_ctz(mask) ;
+			if (memcmp(buf + i + bit + 1, pat + 1, patLen - 2) == 0) {
+				return buf + i + bit ;
+			}
+			mask &= mask - 1 ;
+		}
+	}
+	return findFixedScalar(buf + i, len - i, pat, patLen) ;
+}
+
+#endif
+
+static CountKernel selectCountKernel() {
+#ifdef FILTERS_HAVE_X86
+	__builtin_cpu_init() ;
+	if (__builtin_cpu_supports("avx2")) {
+		return countNewlinesAVX2 ;
+	}
+	return countNewlinesSSE2 ;
+#else
+	return countNewlinesScalar ;
+#endif
+}
+
+static FindKernel selectFindKernel() {
+#ifdef FILTERS_HAVE_X86
+	__builtin_cpu_init() ;
+	if (__builtin_cpu_supports("avx2")) {
+		return findFixedAVX2 ;
+	}
+	return findFixedSSE2 ;
+#else
+	return findFixedScalar ;
+#endif
+}
+
+static CountKernel countKernel = selectCountKernel() ;
+static FindKernel findKernel = selectFindKernel() ;
+
+/*
+ * ===  MEMBER FUNCTION CLASS : Filters  ==============================================
+ *         Name:  useKernel
+ *    Arguments:  Kernel kernel - Kernel set to use from now on.
+ *      Returns:  True if the cpu supports the kernel set. False otherwise, in which case
+ *                the current kernels are kept.
+ *  Description:  Lets the kernel test run every version on the same machine.
+ * =====================================================================================
+ */
+
+bool Filters::useKernel(Kernel kernel) {
+	if (kernel == SCALAR) {
+		countKernel = countNewlinesScalar ;
+		findKernel = findFixedScalar ;
+		return true ;
+	}
+#ifdef FILTERS_HAVE_X86
+	__builtin_cpu_init() ;
+	if (kernel == SSE2) {
+		countKernel = countNewlinesSSE2 ;
+		findKernel = findFixedSSE2 ;
+		return true ;
+	} else if (kernel == AVX2 && __builtin_cpu_supports("avx2")) {
+		countKernel = countNewlinesAVX2 ;
+		findKernel = findFixedAVX2 ;
+		return true ;
+	}
+#endif
+	return false ;
+}		/* -----  end of member function useKernel  ----- */
+
+/*
+ * ===  MEMBER FUNCTION CLASS : Filters  ==============================================
+ *         Name:  countNewlines
+ *    Arguments:  const char * buf - Start of the buffer.
+ *                size_t len - Length of the buffer.
+ *      Returns:  The number of '\n' characters in the buffer.
+ * =====================================================================================
+ */
+
+size_t Filters::countNewlines(const char * buf, size_t len) {
+	return countKernel(buf, len) ;
+}		/* -----  end of member function countNewlines  ----- */
+
+/*
+ * ===  MEMBER FUNCTION CLASS : Filters  ==============================================
+ *         Name:  findFixed
+ *    Arguments:  const char * buf - Start of the buffer.
+ *                size_t len - Length of the buffer.
+ *                const std::string & pat - Fixed string to look for.
+ *      Returns:  Pointer to the first occurrence of pat in the buffer, NULL if none.
+ * =====================================================================================
+ */
+
+const char * Filters::findFixed(const char * buf, size_t len, const std::string & pat) {
+	if (pat.size() == 0) {
+		return buf ;
+	} else if (pat.size() == 1) {
+		return static_cast<const char *>(memchr(buf, pat[0], len)) ;
+	} else if (pat.size() > len) {
+		return NULL ;
+	}
+	return findKernel(buf, len, pat.c_str(), pat.size()) ;
+}		/* -----  end of member function findFixed  ----- */
+
+/*
+ * ===  MEMBER FUNCTION CLASS : Filters  ==============================================
+ *         Name:  isBuiltin
+ *    Arguments:  const std::vector<std::string> & cmd - Command and arguments.
+ *      Returns:  True if the command can be run in process. False otherwise.
+ *  Description:  Only the option sets handled by the builtins are accepted, anything
+ *                else is left to the real binary.
+ * =====================================================================================
+ */
+
+bool Filters::isBuiltin(const std::vector<std::string> & cmd) {
+	bool flag ;
+	long count ;
+	std::string pattern, file ;
+	if (cmd[0].compare("wc") == 0) {
+		return parseWc(cmd, flag, file) ;
+	} else if (cmd[0].compare("grep") == 0) {
+		return parseGrep(cmd, pattern, flag, file) ;
+	} else if (cmd[0].compare("head") == 0 || cmd[0].compare("tail") == 0) {
+		return parseCount(cmd, count, file) ;
+	}
+	return false ;
+}		/* -----  end of member function isBuiltin  ----- */
+
+/*
+ * ===  MEMBER FUNCTION CLASS : Filters  ==============================================
+ *         Name:  run
+ *    Arguments:  const std::vector<std::string> & cmd - Command and arguments.
+ *      Returns:  The exit status of the builtin.
+ * =====================================================================================
+ */
+
+int Filters::run(const std::vector<std::string> & cmd) {
+	if (cmd[0].compare("wc") == 0) {
+		return wordCount(cmd) ;
+	} else if (cmd[0].compare("grep") == 0) {
+		return grepFixed(cmd) ;
+	} else if (cmd[0].compare("head") == 0) {
+		return head(cmd) ;
+	}
+	return tail(cmd) ;
+}		/* -----  end of member function run  ----- */
+
+/*
+ * ===  MEMBER FUNCTION CLASS : Filters  ==============================================
+ *         Name:  wordCount
+ *    Arguments:  const std::vector<std::string> & cmd - "wc -l|-c [file]".
+ *      Returns:  The exit status.
+ *  Description:  Counts lines or bytes of the input.
+ * =====================================================================================
+ */
+
+int Filters::wordCount(const std::vector<std::string> & cmd) {
+	bool lines ;
+	std::string file ;
+	parseWc(cmd, lines, file) ;
+	int fd = openInput(file) ;
+	if (fd < 0) {
+		return EXIT_FAILURE ;
+	}
+	std::vector<char> buf(readSize) ;
+	size_t count = 0 ;
+	ssize_t bytes ;
+	while ((bytes = readSome(fd, buf.data(), buf.size())) > 0) {
+		count += lines ? countNewlines(buf.data(), bytes) : bytes ;
+	}
+	std::string out = std::to_string(count) ;
+	if (!file.empty()) {
+		out += " " + file ;
+	}
+	out += "\n" ;
+	writeAll(out.data(), out.size()) ;
+	return (bytes < 0) ? EXIT_FAILURE : EXIT_SUCCESS ;
+}		/* -----  end of member function wordCount  ----- */
+
+/*
+ * ===  MEMBER FUNCTION CLASS : Filters  ==============================================
+ *         Name:  grepFixed
+ *    Arguments:  const std::vector<std::string> & cmd - "grep -F [-c] pattern [file]".
+ *      Returns:  0 if a line matched, 1 if none did.
+ *  Description:  Prints the lines (or number of lines with -c) containing the fixed
+ *                string. The whole buffer is searched at once rather than line by
+ *                line, only the lines around each match are located.
+ * =====================================================================================
+ */
+
+int Filters::grepFixed(const std::vector<std::string> & cmd) {
+	std::string pattern, file ;
+	bool countOnly ;
+	parseGrep(cmd, pattern, countOnly, file) ;
+	int fd = openInput(file) ;
+	if (fd < 0) {
+		return 2 ;
+	}
+	std::vector<char> buf(readSize) ;
+	size_t len = 0 ;
+	size_t matches = 0 ;
+	bool eof = false ;
+	while (!eof) {
+		ssize_t bytes = readSome(fd, buf.data() + len, buf.size() - len) ;
+		if (bytes < 0) {
+			return 2 ;
+		}
+		len += bytes ;
+		size_t regionLen ;
+		if (bytes == 0) {
+			eof = true ;
+			if (len == 0) {
+				break ;
+			}
+			// Terminate a final line that has no newline. //
+			if (buf[len-1] != '\n') {
+				if (len == buf.size()) {
+					buf.resize(buf.size() + 1) ;
+				}
+				buf[len++] = '\n' ;
+			}
+			regionLen = len ;
+		} else {
+			const char * lastNewline = static_cast<const char *>(memrchr(buf.data(), '\n', len)) ;
+			if (lastNewline == NULL) {
+				// Line longer than the buffer. //
+				if (len == buf.size()) {
+					buf.resize(buf.size() * 2) ;
+				}
+				continue ;
+			}
+			regionLen = lastNewline - buf.data() + 1 ;
+		}
+
+		// Search complete lines in [0, regionLen). //
+		const char * pos = buf.data() ;
+		const char * end = buf.data() + regionLen ;
+		std::string out ;
+		while (pos < end) {
+			const char * match = findFixed(pos, end - pos, pattern) ;
+			if (match == NULL) {
+				break ;
+			}
+			const char * lineStart = static_cast<const char *>(memrchr(pos, '\n', match - pos)) ;
+			lineStart = (lineStart == NULL) ? pos : lineStart + 1 ;
+			const char * lineEnd = static_cast<const char *>(memchr(match, '\n', end - match)) ;
+			if (!countOnly) {
+				out.append(lineStart, lineEnd + 1) ;
+			}
+			++matches ;
+			pos = lineEnd + 1 ;
+		}
+		if (!writeAll(out.data(), out.size())) {
+			return 2 ;
+		}
+		memmove(buf.data(), buf.data() + regionLen, len - regionLen) ;
+		len -= regionLen ;
+	}
+	if (countOnly) {
+		std::string out = std::to_string(matches) + "\n" ;
+		writeAll(out.data(), out.size()) ;
+	}
+	return (matches > 0) ? EXIT_SUCCESS : EXIT_FAILURE ;
+}		/* -----  end of member function grepFixed  ----- */
+
+/*
+ * ===  MEMBER FUNCTION CLASS : Filters  ==============================================
+ *         Name:  head
+ *    Arguments:  const std::vector<std::string> & cmd - "head [-n N|-N] [file]".
+ *      Returns:  The exit status.
+ *  Description:  Prints the first N lines of the input. Whole blocks are counted
+ *                with the newline kernel until the block holding the last line.
+ * =====================================================================================
+ */
+
+int Filters::head(const std::vector<std::string> & cmd) {
+	long remaining ;
+	std::string file ;
+	parseCount(cmd, remaining, file) ;
+	int fd = openInput(file) ;
+	if (fd < 0) {
+		return EXIT_FAILURE ;
+	}
+	std::vector<char> buf(readSize) ;
+	ssize_t bytes = 0 ;
+	while (remaining > 0 && (bytes = readSome(fd, buf.data(), buf.size())) > 0) {
+		size_t count = countNewlines(buf.data(), bytes) ;
+		if (count < static_cast<size_t>(remaining)) {
+			remaining -= count ;
+			if (!writeAll(buf.data(), bytes)) {
+				return EXIT_FAILURE ;
+			}
+		} else {
+			const char * pos = buf.data() ;
+			while (remaining > 0) {
+				pos = static_cast<const char *>(memchr(pos, '\n', buf.data() + bytes - pos)) + 1 ;
+				--remaining ;
+			}
+			if (!writeAll(buf.data(), pos - buf.data())) {
+				return EXIT_FAILURE ;
+			}
+		}
+	}
+	return (bytes < 0) ? EXIT_FAILURE : EXIT_SUCCESS ;
+}		/* -----  end of member function head  ----- */
+
+/*
+ * ===  MEMBER FUNCTION CLASS : Filters  ==============================================
+ *         Name:  tail
+ *    Arguments:  const std::vector<std::string> & cmd - "tail [-n N|-N] [file]".
+ *      Returns:  The exit status.
+ *  Description:  Prints the last N lines of the input. Regular files are scanned
+ *                backwards a chunk at a time, counting newlines until the start of the
+ *                last N lines is found, and then copied forwards from there. Other input
+ *                is kept as a queue of chunks, dropping whole chunks from the front once
+ *                the rest still hold more than N lines.
+ * =====================================================================================
+ */
+
+static size_t lastLinesOffset(const std::string & data, long lines) {
+	if (data.empty()) {
+		return 0 ;
+	}
+	// A trailing newline ends the last line rather than starting a new one. //
+	size_t searchEnd = (data[data.size()-1] == '\n') ? data.size() - 1 : data.size() ;
+	size_t start = data.size() ;
+	for (long i = 0 ; i < lines ; ++i) {
+		const char * nl = static_cast<const char *>(memrchr(data.data(), '\n', searchEnd)) ;
+		if (nl == NULL) {
+			return 0 ;
+		}
+		searchEnd = nl - data.data() ;
+		start = searchEnd + 1 ;
+	}
+	return start ;
+}
+
+int Filters::tail(const std::vector<std::string> & cmd) {
+	long lines ;
+	std::string file ;
+	parseCount(cmd, lines, file) ;
+	int fd = openInput(file) ;
+	if (fd < 0) {
+		return EXIT_FAILURE ;
+	}
+	std::vector<char> buf(readSize) ;
+	ssize_t bytes ;
+	off_t size = lseek(fd, 0, SEEK_END) ;
+	struct stat info ;
+	if (size > 0 && fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+		off_t offset = size ;
+		off_t start = (lines > 0) ? 0 : size ;
+		size_t needed = lines ;
+		while (offset > 0 && needed > 0) {
+			size_t chunk = std::min(static_cast<off_t>(buf.size()), offset) ;
+			offset -= chunk ;
+			if (pread(fd, buf.data(), chunk, offset) != static_cast<ssize_t>(chunk)) {
+				return EXIT_FAILURE ;
+			}
+			// A trailing newline ends the last line rather than starting a new one. //
+			size_t searchEnd = chunk ;
+			if (offset + static_cast<off_t>(chunk) == size && buf[chunk-1] == '\n') {
+				--searchEnd ;
+			}
+			size_t found = countNewlines(buf.data(), searchEnd) ;
+			if (found < needed) {
+				needed -= found ;
+				continue ;
+			}
+			for ( ; needed > 0 ; --needed) {
+				searchEnd = static_cast<const char *>(memrchr(buf.data(), '\n', searchEnd)) - buf.data() ;
+			}
+			start = offset + searchEnd + 1 ;
+		}
+		if (lseek(fd, start, SEEK_SET) != start) {
+			return EXIT_FAILURE ;
+		}
+		while ((bytes = readSome(fd, buf.data(), buf.size())) > 0) {
+			if (!writeAll(buf.data(), bytes)) {
+				return EXIT_FAILURE ;
+			}
+		}
+		return (bytes < 0) ? EXIT_FAILURE : EXIT_SUCCESS ;
+	}
+	std::deque<std::string> chunks ;
+	std::deque<size_t> chunkLines ;
+	size_t keptLines = 0 ;
+	while ((bytes = readSome(fd, buf.data(), buf.size())) > 0) {
+		chunks.push_back(std::string(buf.data(), bytes)) ;
+		chunkLines.push_back(countNewlines(buf.data(), bytes)) ;
+		keptLines += chunkLines.back() ;
+		while (chunks.size() > 1 && keptLines - chunkLines.front() > static_cast<size_t>(lines)) {
+			keptLines -= chunkLines.front() ;
+			chunks.pop_front() ;
+			chunkLines.pop_front() ;
+		}
+	}
+	std::string data ;
+	for (size_t i = 0 ; i < chunks.size() ; ++i) {
+		data.append(chunks[i]) ;
+	}
+	size_t start = lastLinesOffset(data, lines) ;
+	if (!writeAll(data.data() + start, data.size() - start)) {
+		return EXIT_FAILURE ;
+	}
+	return (bytes < 0) ? EXIT_FAILURE : EXIT_SUCCESS ;
+}		/* -----  end of member function tail  ----- */
+
+/*
+ * ===  MEMBER FUNCTION CLASS : Filters  ==============================================
+ *         Name:  parseWc
+ *    Arguments:  const std::vector<std::string> & cmd - Command and arguments.
+ *                bool & lines - Set to true for -l, false for -c.
+ *                std::string & file - Set to the input file, empty for stdin.
+ *      Returns:  True if the arguments are supported.
+ * =====================================================================================
+ */
+
+bool Filters::parseWc(const std::vector<std::string> & cmd, bool & lines, std::string & file) {
+	if (cmd.size() < 2 || cmd.size() > 3) {
+		return false ;
+	}
+	if (cmd[1].compare("-l") == 0) {
+		lines = true ;
+	} else if (cmd[1].compare("-c") == 0) {
+		lines = false ;
+	} else {
+		return false ;
+	}
+	file = (cmd.size() == 3) ? cmd[2] : "" ;
+	return file.empty() || file[0] != '-' ;
+}		/* -----  end of member function parseWc  ----- */
+
+/*
+ * ===  MEMBER FUNCTION CLASS : Filters  ==============================================
+ *         Name:  parseGrep
+ *    Arguments:  const std::vector<std::string> & cmd - Command and arguments.
+ *                std::string & pattern - Set to the fixed string.
+ *                bool & countOnly - Set to true if -c was given.
+ *                std::string & file - Set to the input file, empty for stdin.
+ *      Returns:  True if the arguments are supported. -F is required.
+ * =====================================================================================
+ */
+
+bool Filters::parseGrep(const std::vector<std::string> & cmd, std::string & pattern,
+		bool & countOnly, std::string & file) {
+	bool fixed = false ;
+	countOnly = false ;
+	unsigned int i = 1 ;
+	for ( ; i < cmd.size() && cmd[i].size() > 1 && cmd[i][0] == '-' ; ++i) {
+		if (cmd[i].compare("-F") == 0) {
+			fixed = true ;
+		} else if (cmd[i].compare("-c") == 0) {
+			countOnly = true ;
+		} else {
+			return false ;
+		}
+	}
+	if (!fixed || i >= cmd.size()) {
+		return false ;
+	}
+	pattern = cmd[i++] ;
+	file = (i < cmd.size()) ? cmd[i++] : "" ;
+	return i == cmd.size() ;
+}		/* -----  end of member function parseGrep  ----- */
+
+/*
+ * ===  MEMBER FUNCTION CLASS : Filters  ==============================================
+ *         Name:  parseCount
+ *    Arguments:  const std::vector<std::string> & cmd - Command and arguments.
+ *                long & count - Set to the number of lines, default 10.
+ *                std::string & file - Set to the input file, empty for stdin.
+ *      Returns:  True if the arguments are supported.
+ * =====================================================================================
+ */
+
+bool Filters::parseCount(const std::vector<std::string> & cmd, long & count, std::string & file) {
+	count = 10 ;
+	unsigned int i = 1 ;
+	if (i + 1 < cmd.size() && cmd[i].compare("-n") == 0 && isdigit(cmd[i+1][0])) {
+		count = atol(cmd[i+1].c_str()) ;
+		i += 2 ;
+	} else if (i < cmd.size() && cmd[i].size() > 1 && cmd[i][0] == '-' && isdigit(cmd[i][1])) {
+		count = atol(cmd[i].c_str() + 1) ;
+		++i ;
+	}
+	file = "" ;
+	if (i < cmd.size() && cmd[i][0] != '-') {
+		file = cmd[i++] ;
+	}
+	return i == cmd.size() ;
+}		/* -----  end of member function parseCount  ----- */
+
+/*
+ * ===  MEMBER FUNCTION CLASS : Filters  ==============================================
+ *         Name:  openInput
+ *    Arguments:  const std::string & file - File to open, empty for stdin.
+ *      Returns:  The file descriptor, -1 on error.
+ * =====================================================================================
+ */
+
+int Filters::openInput(const std::string & file) {
+	if (file.empty()) {
+		return STDIN_FILENO ;
+	}
+	int fd = open(file.c_str(), O_RDONLY) ;
+	if (fd < 0) {
+		std::cerr << "Error cannot open " << file << ": " << strerror(errno) << std::endl ;
+	}
+	return fd ;
+}		/* -----  end of member function openInput  ----- */
+
+/*
+ * ===  MEMBER FUNCTION CLASS : Filters  ==============================================
+ *         Name:  readSome
+ *    Arguments:  int fd - Descriptor to read.
+ *                char * buf - Destination.
+ *                size_t len - Maximum number of bytes.
+ *      Returns:  Bytes read, 0 at end of input, -1 on error.
+ * =====================================================================================
+ */
+
+ssize_t Filters::readSome(int fd, char * buf, size_t len) {
+	ssize_t bytes ;
+	while ((bytes = read(fd, buf, len)) == -1 && errno == EINTR) {} ;
+	return bytes ;
+}		/* -----  end of member function readSome  ----- */
+
+/*
+ * ===  MEMBER FUNCTION CLASS : Filters  ==============================================
+ *         Name:  writeAll
+ *    Arguments:  const char * buf - Data to write.
+ *                size_t len - Length of data.
+ *      Returns:  True if everything was written to stdout.
+ * =====================================================================================
+ */
+
+bool Filters::writeAll(const char * buf, size_t len) {
+	while (len > 0) {
+		ssize_t bytes = write(STDOUT_FILENO, buf, len) ;
+		if (bytes < 0) {
+			if (errno == EINTR) {
+				continue ;
+			}
+			return false ;
+		}
+		buf += bytes ;
+		len -= bytes ;
+	}
+	return true ;
+}		/* -----  end of member function writeAll  ----- */
@@ -0,0 +1,61 @@
+#ifndef FILTERS_HPP_K3QZ8WNA
+#define FILTERS_HPP_K3QZ8WNA
+
+/*
+ * =====================================================================================
+ *
+ *       Filename:  filters.hpp
+ *
+ *    Description:  In-process filter builtins (wc, grep -F, head, tail).
+ *
+ *        Version:  1.0
+ *        Created:  19/10/26 10:02:17
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Michael Tierney (MT), tiernemi@tcd.ie
+ *
+ * =====================================================================================
+ */
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <sys/types.h>
+
+/*
+ * ===  CLASS  =========================================================================
+ *         Name:  Filters
+ *  Description:  Helper class for running common pipeline filters inside the forked
+ *                child instead of exec'ing the coreutils binaries. Newline counting
+ *                and fixed string search use AVX2 or SSE2 kernels when the cpu
+ *                supports them and fall back to scalar code otherwise.
+ * =====================================================================================
+ */
+
+class Filters {
+ public:
+	enum Kernel {
+		SCALAR,
+		SSE2,
+		AVX2
+	} ;
+	static bool useKernel(Kernel) ;
+	static bool isBuiltin(const std::vector<std::string> &) ;
+	static int run(const std::vector<std::string> &) ;
+	static size_t countNewlines(const char *, size_t) ;
+	static const char * findFixed(const char *, size_t, const std::string &) ;
+ private:
+	static int wordCount(const std::vector<std::string> &) ;
+	static int grepFixed(const std::vector<std::string> &) ;
+	static int head(const std::vector<std::string> &) ;
+	static int tail(const std::vector<std::string> &) ;
+	static bool parseWc(const std::vector<std::string> &, bool &, std::string &) ;
+	static bool parseGrep(const std::vector<std::string> &, std::string &, bool &, std::string &) ;
+	static bool parseCount(const std::vector<std::string> &, long &, std::string &) ;
+	static int openInput(const std::string &) ;
+	static ssize_t readSome(int, char *, size_t) ;
+	static bool writeAll(const char *, size_t) ;
+} ;		/* -----  end of class Filters  ----- */
+
+#endif /* end of include guard: FILTERS_HPP_K3QZ8WNA */
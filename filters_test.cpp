@@ -0,0 +1,112 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  filters_test.cpp
+ *
+ *    Description:  Checks the SIMD filter kernels against naive references.
+ *
+ *        Version:  1.0
+ *        Created:  19/10/26 17:42:10
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Michael Tierney (MT), tiernemi@tcd.ie
+ *
+ * =====================================================================================
+ */
+
+#include "filters.hpp"
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/mman.h>
+
+// Buffers are placed so they end at a PROT_NONE page, any read past the end faults. //
+static char * guardedPage ;
+static size_t pageSize ;
+
+static char * guardedBuffer(size_t len, size_t slack) {
+	return guardedPage + pageSize - slack - len ;
+}
+
+static void fill(char * buf, size_t len, const char * alphabet, size_t letters) {
+	for (size_t i = 0 ; i < len ; ++i) {
+		buf[i] = alphabet[rand() % letters] ;
+	}
+}
+
+static size_t referenceCount(const char * buf, size_t len) {
+	return std::count(buf, buf + len, '\n') ;
+}
+
+static const char * referenceFind(const char * buf, size_t len, const std::string & pat) {
+	const char * found = std::search(buf, buf + len, pat.begin(), pat.end()) ;
+	return (found == buf + len && !pat.empty()) ? NULL : found ;
+}
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  checkKernels
+ *      Returns:  The number of mismatches with the references.
+ *  Description:  Runs random buffers of every length up to a page, at every end
+ *                alignment, through the kernels currently selected.
+ * =====================================================================================
+ */
+
+static int checkKernels() {
+	int failures = 0 ;
+	for (size_t len = 0 ; len < pageSize - 64 ; len += (len < 300) ? 1 : 37) {
+		for (size_t slack = 0 ; slack < 64 ; slack += 7) {
+			char * buf = guardedBuffer(len, slack) ;
+			fill(buf, len, "ab\n", 3) ;
+			if (Filters::countNewlines(buf, len) != referenceCount(buf, len)) {
+				std::cerr << "countNewlines mismatch len " << len << " slack " << slack << std::endl ;
+				++failures ;
+			}
+			fill(buf, len, "abc", 3) ;
+			for (int trial = 0 ; trial < 4 ; ++trial) {
+				std::string pat ;
+				size_t patLen = 2 + rand() % 40 ;
+				if (trial % 2 == 0 && patLen <= len) {
+					// Take the pattern from the buffer so there is at least one match. //
+					pat.assign(buf + rand() % (len - patLen + 1), patLen) ;
+				} else {
+					pat.resize(patLen) ;
+					fill(&pat[0], patLen, "abc", 3) ;
+				}
+				if (Filters::findFixed(buf, len, pat) != referenceFind(buf, len, pat)) {
+					std::cerr << "findFixed mismatch len " << len << " slack " << slack <<
+						" pattern " << pat << std::endl ;
+					++failures ;
+				}
+			}
+		}
+	}
+	return failures ;
+}
+
+int main(int argc, char *argv[]) {
+	pageSize = sysconf(_SC_PAGESIZE) ;
+	void * pages = mmap(NULL, 2 * pageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) ;
+	if (pages == MAP_FAILED || mprotect(static_cast<char *>(pages) + pageSize, pageSize, PROT_NONE) != 0) {
+		std::cerr << "Error cannot map guard page" << std::endl ;
+		return EXIT_FAILURE ;
+	}
+	guardedPage = static_cast<char *>(pages) ;
+	srand(1) ;
+
+	const Filters::Kernel kernels[] = {Filters::SCALAR, Filters::SSE2, Filters::AVX2} ;
+	const char * names[] = {"scalar", "sse2", "avx2"} ;
+	int failures = 0 ;
+	for (unsigned int i = 0 ; i < 3 ; ++i) {
+		if (!Filters::useKernel(kernels[i])) {
+			std::cout << names[i] << " skipped, not supported" << std::endl ;
+			continue ;
+		}
+		int kernelFailures = checkKernels() ;
+		std::cout << names[i] << (kernelFailures ? " FAILED" : " ok") << std::endl ;
+		failures += kernelFailures ;
+	}
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS ;
+}
@@ -16,18 +16,50 @@
  */
 
 #include "shell.hpp"
+#include "trace.hpp"
+#include <iostream>
 
 int main(int argc, char *argv[]) {
+	// Handle trace options. //
+	std::string replayFile ;
+	for (int i = 1 ; i < argc ; ++i) {
+		std::string arg(argv[i]) ;
+		if (i+1 < argc && arg.compare("--trace") == 0) {
+			if (!Trace::open(argv[++i])) {
+				std::cerr << "Error cannot open trace file " << argv[i] << std::endl ;
+				return EXIT_FAILURE ;
+			}
+		} else if (i+1 < argc && arg.compare("--replay") == 0) {
+			replayFile = argv[++i] ;
+		} else if (i+1 < argc && arg.compare("--simulate") == 0) {
+			return Trace::simulate(argv[i+1], std::cout) ? EXIT_SUCCESS : EXIT_FAILURE ;
+		} else if (i+1 < argc && arg.compare("--chrome") == 0) {
+			return Trace::exportChrome(argv[i+1], std::cout) ? EXIT_SUCCESS : EXIT_FAILURE ;
+		} else {
+			std::cerr << "Usage: " << argv[0] << " [--trace file] [--replay file]" <<
+				" | --simulate file | --chrome file" << std::endl ;
+			return EXIT_FAILURE ;
+		}
+	}
+
 	// Create new shell. //
 	Shell newShell ;
-	newShell.displayShellName() ;
-	while (1) {
-		// Check background processes. //
-		newShell.checkBackgrounds() ;
-		// Get input. //
-		std::string cmd = newShell.prompt() ;
-		// Execute input. //
-		newShell.execute(cmd) ;
+	// Execute recorded command lines again. //
+	if (!replayFile.empty()) {
+		std::vector<std::string> lines ;
+		if (!Trace::commandLines(replayFile, lines)) {
+			std::cerr << "Error cannot read trace file " << replayFile << std::endl ;
+			return EXIT_FAILURE ;
+		}
+		for (unsigned int i = 0 ; i < lines.size() ; ++i) {
+			newShell.execute(lines[i]) ;
+		}
+		// Reap background jobs so the trace records when they finished. //
+		std::cout << newShell.waitBackgrounds() ;
+		return EXIT_SUCCESS ;
 	}
+	newShell.displayShellName() ;
+	// Read and execute commands until end of input. //
+	newShell.run() ;
 	return EXIT_SUCCESS ;
 }
@@ -16,6 +16,8 @@
  */
 
 #include "shell.hpp"
+#include "filters.hpp"
+#include "trace.hpp"
 #include <unistd.h>
 #include <sys/types.h>
 #include <readline/readline.h>
@@ -27,6 +29,53 @@
 #include <sys/stat.h>
 #include <libgen.h>
 #include <wordexp.h> 
+#include <cstring>
+#include <algorithm>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <signal.h>
+
+// Seconds between refreshes of the prompt segment. //
+static const int segmentInterval = 10 ;
+
+Shell * Shell::activeShell = NULL ;
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  restoreSignals
+ *  Description:  Unblocks SIGCHLD, which the shell blocks for its signalfd, so that
+ *                children do not inherit the blocked mask.
+ * =====================================================================================
+ */
+
+static void restoreSignals() {
+	sigset_t childMask ;
+	sigemptyset(&childMask) ;
+	sigaddset(&childMask, SIGCHLD) ;
+	sigprocmask(SIG_UNBLOCK, &childMask, NULL) ;
+}		/* -----  end of function restoreSignals  ----- */
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  isBatched
+ *    Arguments:  const std::vector<std::string> & cmd
+ *      Returns:  True if cmd is "batch [-j N] command args...". Anything else, e.g. a
+ *                bare "batch" or "batch -f file", is left to the at batch utility.
+ * =====================================================================================
+ */
+
+static bool isBatched(const std::vector<std::string> & cmd) {
+	if (cmd[0].compare("batch") != 0) {
+		return false ;
+	}
+	unsigned int start = (cmd.size() > 2 && cmd[1].compare("-j") == 0) ? 3 : 1 ;
+	return start < cmd.size() && !cmd[start].empty() && cmd[start][0] != '-' ;
+}		/* -----  end of function isBatched  ----- */
 
 /*
  * ===  MEMBER FUNCTION CLASS : Shell  ===============================================
@@ -50,32 +99,67 @@ Shell::Shell() {
 	terminalFD = open(ctermid(NULL), O_WRONLY) ;
 	shellPGID = getpgid(shellPID) ;
 	signal(SIGTTOU, SIG_IGN) ;
+	spreadStages = false ;
+	pipeStage = 0 ;
+	pinned = false ;
+	inPipeline = false ;
+	spreadBase = 0 ;
+	spreadNext = 0 ;
+	segmentPID = -1 ;
+	epollFD = -1 ;
+	signalFD = -1 ;
+	timerFD = -1 ;
+	segmentFD = -1 ;
 }		/* -----  end of member function Shell  ----- */
 
 /* 
  * ===  MEMBER FUNCTION CLASS : Shell  ================================================
  *         Name:  checkBackgrounds
+ *      Returns:  One "Done" line for each background process that has completed.
  *  Description:  Function that examines background processes spawned by the shell and
  *                alerts the user if they have been completed.
  * =====================================================================================
  */
 
-void Shell::checkBackgrounds() {
+std::string Shell::checkBackgrounds() {
+	std::string notices ;
 	for (unsigned int i = 0 ; i < backgroundCommandsPIDs.size() ; ++i) {
 		int status ;
 		int wpid ;
 		wpid = waitpid(backgroundCommandsPIDs[i], &status, WNOHANG) ;
 		if (wpid != 0) {
-			std::cout << "[" << i+1 << "]   " << "Done           " << 
-				backgroundCommands[i] << std::endl ;
+			Trace::wait(wpid, status) ;
+			notices += "[" + std::to_string(i+1) + "]   " + "Done           " + 
+				backgroundCommands[i] + "\n" ;
 			backgroundCommands.erase(backgroundCommands.begin()+i) ;
 			backgroundCommandsPIDs.erase(backgroundCommandsPIDs.begin()+i) ;
 			backgroundCommandsIDs.erase(backgroundCommandsIDs.begin()+i) ;
 			--i ;
 		}
 	}
+	return notices ;
 }		/* -----  end of member function checkBackgrounds  ----- */
 
+/* 
+ * ===  MEMBER FUNCTION CLASS : Shell  =================================================
+ *         Name:  waitBackgrounds
+ *      Returns:  One "Done" line for each background process.
+ *  Description:  Blocks until every background process has completed and reaps them
+ *                through checkBackgrounds.
+ * =====================================================================================
+ */
+
+std::string Shell::waitBackgrounds() {
+	std::string notices ;
+	while (!backgroundCommandsPIDs.empty()) {
+		// Wait without reaping so checkBackgrounds still sees the status. //
+		siginfo_t info ;
+		waitid(P_PID, backgroundCommandsPIDs[0], &info, WEXITED | WNOWAIT) ;
+		notices += checkBackgrounds() ;
+	}
+	return notices ;
+}		/* -----  end of member function waitBackgrounds  ----- */
+
 /* 
  * ===  MEMBER FUNCTION CLASS : Shell  =================================================
  *         Name:  createPrompt
@@ -85,13 +169,266 @@ void Shell::checkBackgrounds() {
  */
 
 std::string Shell::prompt() {
-	std::string promptStrng = currDirectory + ":$ " ;
+	std::string promptStrng = promptString() ;
 	char * cmd = readline(promptStrng.c_str()) ;
+	if (cmd == NULL) {
+		std::cout << std::endl ;
+		exit(EXIT_SUCCESS) ;
+	}
 	add_history(cmd) ;
 	std::string cmdStr(cmd) ;
+	free(cmd) ;
 	return cmdStr ;
 }		/* -----  end of member function createPrompt  ----- */
 
+/* 
+ * ===  MEMBER FUNCTION CLASS : Shell  =================================================
+ *         Name:  promptString
+ *      Returns:  The prompt for the current directory and git branch.
+ * =====================================================================================
+ */
+
+std::string Shell::promptString() {
+	if (promptSegment.empty()) {
+		return currDirectory + ":$ " ;
+	}
+	return currDirectory + " (" + promptSegment + "):$ " ;
+}		/* -----  end of member function promptString  ----- */
+
+/* 
+ * ===  MEMBER FUNCTION CLASS : Shell  =================================================
+ *         Name:  run
+ *  Description:  Main loop of the shell. Input is read with the readline callback
+ *                interface from an epoll loop that also waits on a signalfd for
+ *                SIGCHLD, a timerfd and the prompt segment helper. Background jobs
+ *                are reported as soon as they finish, above the line being edited,
+ *                and the git branch in the prompt never blocks input. Falls back to
+ *                blocking readline if stdin cannot be polled (e.g. a regular file).
+ * =====================================================================================
+ */
+
+void Shell::run() {
+	activeShell = this ;
+	sigset_t childMask ;
+	sigemptyset(&childMask) ;
+	sigaddset(&childMask, SIGCHLD) ;
+	sigprocmask(SIG_BLOCK, &childMask, NULL) ;
+	signalFD = signalfd(-1, &childMask, SFD_NONBLOCK | SFD_CLOEXEC) ;
+	// Armed by readSegment only while inside a git repository. //
+	timerFD = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC) ;
+	epollFD = epoll_create1(EPOLL_CLOEXEC) ;
+
+	if (!watch(STDIN_FILENO) || !watch(signalFD) || !watch(timerFD)) {
+		sigprocmask(SIG_UNBLOCK, &childMask, NULL) ;
+		while (1) {
+			std::cout << checkBackgrounds() ;
+			std::string cmd = prompt() ;
+			execute(cmd) ;
+		}
+	}
+
+	refreshSegment() ;
+	rl_callback_handler_install(promptString().c_str(), lineHandler) ;
+	struct epoll_event events[8] ;
+	while (1) {
+		int ready = epoll_wait(epollFD, events, 8, -1) ;
+		if (ready == -1) {
+			if (errno == EINTR) {
+				continue ;
+			}
+			std::cerr << "Error waiting for input: " << strerror(errno) << std::endl ;
+			exit(EXIT_FAILURE) ;
+		}
+		for (int i = 0 ; i < ready ; ++i) {
+			int fd = events[i].data.fd ;
+			if (fd == STDIN_FILENO) {
+				rl_callback_read_char() ;
+			} else if (fd == signalFD) {
+				struct signalfd_siginfo info ;
+				while (read(signalFD, &info, sizeof(info)) == sizeof(info)) {} ;
+				std::string notices = checkBackgrounds() ;
+				if (!notices.empty()) {
+					printAbovePrompt(notices) ;
+				}
+			} else if (fd == timerFD) {
+				uint64_t expirations ;
+				while (read(timerFD, &expirations, sizeof(expirations)) == sizeof(expirations)) {} ;
+				refreshSegment() ;
+			} else if (fd == segmentFD) {
+				readSegment() ;
+			}
+		}
+	}
+}		/* -----  end of member function run  ----- */
+
+/* 
+ * ===  MEMBER FUNCTION CLASS : Shell  =================================================
+ *         Name:  lineHandler
+ *    Arguments:  char * line - Line read by readline, NULL at end of input.
+ *  Description:  Readline callback, forwards to the running shell.
+ * =====================================================================================
+ */
+
+void Shell::lineHandler(char * line) {
+	activeShell->handleLine(line) ;
+}		/* -----  end of member function lineHandler  ----- */
+
+/* 
+ * ===  MEMBER FUNCTION CLASS : Shell  =================================================
+ *         Name:  handleLine
+ *    Arguments:  char * line - Line read by readline, NULL at end of input.
+ *  Description:  Executes a completed line and sets up the prompt for the next one.
+ * =====================================================================================
+ */
+
+void Shell::handleLine(char * line) {
+	if (line == NULL) {
+		rl_callback_handler_remove() ;
+		std::cout << std::endl ;
+		exit(EXIT_SUCCESS) ;
+	}
+	std::string cmd(line) ;
+	if (*line != '\0') {
+		add_history(line) ;
+	}
+	free(line) ;
+	execute(cmd) ;
+	// Outside a repository only a change of directory can change the branch. //
+	if (!promptSegment.empty() || currDirectory.compare(segmentDirectory) != 0) {
+		refreshSegment() ;
+	}
+	rl_set_prompt(promptString().c_str()) ;
+}		/* -----  end of member function handleLine  ----- */
+
+/* 
+ * ===  MEMBER FUNCTION CLASS : Shell  =================================================
+ *         Name:  printAbovePrompt
+ *    Arguments:  const std::string & text - Text to print, ending in a newline. May
+ *                be empty to just redraw.
+ *  Description:  Prints text on its own lines and redraws the current prompt and the
+ *                partly typed line below it.
+ * =====================================================================================
+ */
+
+void Shell::printAbovePrompt(const std::string & text) {
+	int savedPoint = rl_point ;
+	char * savedLine = rl_copy_text(0, rl_end) ;
+	rl_save_prompt() ;
+	rl_replace_line("", 0) ;
+	rl_redisplay() ;
+	std::cout << text << std::flush ;
+	rl_restore_prompt() ;
+	rl_set_prompt(promptString().c_str()) ;
+	rl_replace_line(savedLine, 0) ;
+	rl_point = savedPoint ;
+	rl_on_new_line() ;
+	rl_redisplay() ;
+	free(savedLine) ;
+}		/* -----  end of member function printAbovePrompt  ----- */
+
+/* 
+ * ===  MEMBER FUNCTION CLASS : Shell  =================================================
+ *         Name:  watch
+ *    Arguments:  int fd - Descriptor to add to the main loop.
+ *      Returns:  True if the descriptor can be polled.
+ * =====================================================================================
+ */
+
+bool Shell::watch(int fd) {
+	struct epoll_event event ;
+	event.events = EPOLLIN ;
+	event.data.fd = fd ;
+	return fd >= 0 && epoll_ctl(epollFD, EPOLL_CTL_ADD, fd, &event) == 0 ;
+}		/* -----  end of member function watch  ----- */
+
+/* 
+ * ===  MEMBER FUNCTION CLASS : Shell  =================================================
+ *         Name:  refreshSegment
+ *  Description:  Starts a helper that prints the git branch of the current directory.
+ *                Its output is collected by the main loop so the prompt is never
+ *                held up by git. Does nothing if a helper is already running.
+ * =====================================================================================
+ */
+
+void Shell::refreshSegment() {
+	if (segmentPID > 0 || epollFD < 0) {
+		return ;
+	}
+	int fd[2] ;
+	if (pipe2(fd, O_CLOEXEC) == -1) {
+		return ;
+	}
+	if ((segmentPID = fork()) < 0) {
+		close(fd[0]) ;
+		close(fd[1]) ;
+		segmentPID = -1 ;
+		return ;
+	} else if (segmentPID == 0) {
+		restoreSignals() ;
+		int devNull = open("/dev/null", O_WRONLY) ;
+		dup2(fd[1], STDOUT_FILENO) ;
+		dup2(devNull, STDERR_FILENO) ;
+		execlp("git", "git", "rev-parse", "--abbrev-ref", "HEAD", (char *) NULL) ;
+		_exit(EXIT_FAILURE) ;
+	}
+	close(fd[1]) ;
+	fcntl(fd[0], F_SETFL, O_NONBLOCK) ;
+	segmentFD = fd[0] ;
+	segmentOutput.clear() ;
+	segmentDirectory = currDirectory ;
+	watch(segmentFD) ;
+}		/* -----  end of member function refreshSegment  ----- */
+
+/* 
+ * ===  MEMBER FUNCTION CLASS : Shell  =================================================
+ *         Name:  readSegment
+ *  Description:  Reads the helper's output. Once the helper is finished the prompt
+ *                is redrawn if the branch changed.
+ * =====================================================================================
+ */
+
+void Shell::readSegment() {
+	char buf[256] ;
+	ssize_t bytes ;
+	while ((bytes = read(segmentFD, buf, sizeof(buf))) > 0) {
+		segmentOutput.append(buf, bytes) ;
+	}
+	if (bytes < 0 && (errno == EAGAIN || errno == EINTR)) {
+		return ;
+	}
+	epoll_ctl(epollFD, EPOLL_CTL_DEL, segmentFD, NULL) ;
+	close(segmentFD) ;
+	segmentFD = -1 ;
+	int status ;
+	bool ok = waitpid(segmentPID, &status, 0) == segmentPID && WIFEXITED(status) &&
+		WEXITSTATUS(status) == 0 && !segmentOutput.empty() ;
+	segmentPID = -1 ;
+	std::string segment = ok ? segmentOutput.substr(0, segmentOutput.find('\n')) : "" ;
+	// Only poll for branch changes while inside a repository. //
+	armSegmentTimer(!segment.empty()) ;
+	if (segment.compare(promptSegment) != 0) {
+		promptSegment = segment ;
+		printAbovePrompt("") ;
+	}
+}		/* -----  end of member function readSegment  ----- */
+
+/* 
+ * ===  MEMBER FUNCTION CLASS : Shell  =================================================
+ *         Name:  armSegmentTimer
+ *    Arguments:  bool enable - Start or stop the periodic refresh.
+ *  Description:  Refreshes the prompt segment every segmentInterval seconds while
+ *                enabled, so a branch switched from elsewhere shows up.
+ * =====================================================================================
+ */
+
+void Shell::armSegmentTimer(bool enable) {
+	struct itimerspec interval ;
+	interval.it_interval.tv_sec = enable ? segmentInterval : 0 ;
+	interval.it_interval.tv_nsec = 0 ;
+	interval.it_value = interval.it_interval ;
+	timerfd_settime(timerFD, 0, &interval, NULL) ;
+}		/* -----  end of member function armSegmentTimer  ----- */
+
 /* 
  * ===  MEMBER FUNCTION CLASS : Shell  ================================================
  *         Name:  execute
@@ -107,10 +444,13 @@ void Shell::execute(std::string cmd) {
 
 	// Parse commands into seperate groups, then pipes + IO, seperate commands and then arguments. //
 	std::vector<std::vector<std::vector<std::string>>> parsedCmd = Parser::parse(cmd) ;
+	Trace::line(cmd) ;
 
 	for (unsigned int i = 0 ; i < parsedCmd.size() ; ++i) {
+		Trace::group(Trace::PARSE, parsedCmd[i]) ;
 		// Expand wildcards and ~ . //
 		expandArgs(parsedCmd[i]) ;
+		Trace::group(Trace::EXPAND, parsedCmd[i]) ;
 		pid_t child_pid ;
 		int status ;
 		bool bg = false ;
@@ -118,6 +458,8 @@ void Shell::execute(std::string cmd) {
 		// Handle change directory. //
 		if (parsedCmd[i][0][0].compare("cd") == 0 && parsedCmd[i].size() == 1) {
 			changeDirectory(parsedCmd[i][0][1]) ;
+		} else if (parsedCmd[i][0][0].compare("set") == 0 && parsedCmd[i].size() == 1) {
+			setOption(parsedCmd[i][0]) ;
 		} else if (parsedCmd[i][0][0][0] == '/') {
 			std::cout << parsedCmd[i][0][0] << " is a directory" << std::endl;
 		} else if (parsedCmd[i][0][0].compare(".") == 0) {
@@ -127,6 +469,13 @@ void Shell::execute(std::string cmd) {
 		}
 		// Handle regular command. //
 		else {
+			// Give this job's pipeline stages the next free cpus for set -o spread. //
+			unsigned int stages = 1 ;
+			for (unsigned int j = 0 ; j < parsedCmd[i].size() ; ++j) {
+				stages += (parsedCmd[i][j][0].compare("|") == 0) ;
+			}
+			spreadBase = spreadNext ;
+			spreadNext += stages ;
 			// Handle background processes. //
 			if (parsedCmd[i][parsedCmd[i].size()-1][0].compare("&") == 0) {
 				parsedCmd[i].pop_back() ;
@@ -135,21 +484,25 @@ void Shell::execute(std::string cmd) {
 			}
 			// If foreground process then fork. //
 			if (!bg) {
+				uint64_t forkTime = Trace::now() ;
 				if ((child_pid = fork()) < 0) {
 					printf("*** ERROR: forking child process failed\n");
 					exit(1);
 				} else if (child_pid == 0) {
+					restoreSignals() ;
 					runCommand(parsedCmd[i]) ;
 				} else {
+					Trace::fork(child_pid, forkTime) ;
 					setpgid(child_pid, 0) ;
 					tcsetpgrp(terminalFD, getpgid(child_pid)) ;
-					while (wait(&status) != child_pid) {
-						;
-					}
+					// Only this child, background jobs and the prompt helper are reaped elsewhere. //
+					while ((waitpid(child_pid, &status, 0) == -1) && (errno == EINTR)) {} ;
+					Trace::wait(child_pid, status) ;
 					tcsetpgrp(terminalFD, shellPGID) ;
 				}
 			}
 		}
+		Trace::groupEnd() ;
 	}
 }		/* -----  end of member function execute  ----- */
 
@@ -180,57 +533,456 @@ void Shell::runCommand(std::vector<std::vector<std::string>> & cmds) {
 		handleBackground(cmds) ;
 	} else if (currentCmd[0].compare("") == 0) {
 		exit(EXIT_SUCCESS) ;
+	} else if (unsigned int consumed = applyTuning(currentCmd)) {
+		// Prefix applied to this process, run what follows it. //
+		currentCmd.erase(currentCmd.begin(), currentCmd.begin()+consumed) ;
+		cmds.push_back(currentCmd) ;
+		runCommand(cmds) ;
 	} else {
-		char ** args = new char*[currentCmd.size()+1] ;
-		for (unsigned int j = 0 ; j < currentCmd.size() ; ++j) {
-			args[j] = strdup(currentCmd[j].c_str()) ;
+		// Batch chunks keep the whole cpu set so -j can run them in parallel. //
+		bool batched = isBatched(currentCmd) ;
+		if (spreadStages && inPipeline && !pinned && !batched) {
+			pinStage() ;
 		}
-		args[currentCmd.size()] = NULL ;
-		execvpe(args[0], args, environ) ;
-		if (errno == EACCES) {
-			std::cerr << "Error cannot acces command" << std::endl ;
-		} else if (errno == ENOENT) {
-			std::cerr << "Error command " << args[0] <<  " does not exist" << std::endl ;
-		} else if (errno == EIO) {
-			std::cerr << "I/O Error" << std::endl ;
+		if (batched) {
+			runBatched(currentCmd) ;
+		} else if (Filters::isBuiltin(currentCmd)) {
+			// Run filters in this child rather than exec'ing them. //
+			Trace::exec(currentCmd, true) ;
+			exit(Filters::run(currentCmd)) ;
+		} else {
+			execCommand(currentCmd) ;
 		}
-		exit (EXIT_FAILURE) ;
 	}
 }		/* -----  end of member function runCommand  ----- */
 
+/* 
+ * ===  MEMBER FUNCTION CLASS : Shell  =================================================
+ *         Name:  execCommand
+ *    Arguments:  const std::vector<std::string> & cmd - The command and its arguments.
+ *  Description:  Replaces the current process with cmd. Reports the error and exits
+ *                if the exec fails.
+ * =====================================================================================
+ */
+
+void Shell::execCommand(const std::vector<std::string> & cmd) {
+	char ** args = new char*[cmd.size()+1] ;
+	for (unsigned int j = 0 ; j < cmd.size() ; ++j) {
+		args[j] = strdup(cmd[j].c_str()) ;
+	}
+	args[cmd.size()] = NULL ;
+	Trace::exec(cmd, false) ;
+	execvpe(args[0], args, environ) ;
+	Trace::execError(errno) ;
+	if (errno == EACCES) {
+		std::cerr << "Error cannot acces command" << std::endl ;
+	} else if (errno == ENOENT) {
+		std::cerr << "Error command " << args[0] <<  " does not exist" << std::endl ;
+	} else if (errno == EIO) {
+		std::cerr << "I/O Error" << std::endl ;
+	} else if (errno == E2BIG) {
+		std::cerr << "Error argument list too long, try batch " << args[0] << std::endl ;
+	}
+	exit (EXIT_FAILURE) ;
+}		/* -----  end of member function execCommand  ----- */
+
+/* 
+ * ===  MEMBER FUNCTION CLASS : Shell  =================================================
+ *         Name:  runBatched
+ *    Arguments:  std::vector<std::string> & cmd - "batch [-j N] command args...", as
+ *                checked by isBatched.
+ *  Description:  Splits an argument list that is too big for a single exec into
+ *                chunks that fit in ARG_MAX. The command and its leading options are
+ *                repeated for every chunk. Chunks run one after another, or N at a
+ *                time with -j N. Exits with the largest exit status of the chunks.
+ * =====================================================================================
+ */
+
+void Shell::runBatched(std::vector<std::string> & cmd) {
+	unsigned int parallel = 1 ;
+	unsigned int start = 1 ;
+	if (cmd.size() > 2 && cmd[1].compare("-j") == 0) {
+		int n = atoi(cmd[2].c_str()) ;
+		parallel = (n > 0) ? n : 1 ;
+		start = 3 ;
+	}
+
+	// Work out how much room is left once the environment is accounted for. //
+	long limit = sysconf(_SC_ARG_MAX) ;
+	if (limit <= 0) {
+		limit = 131072 ;
+	}
+	for (char ** env = environ ; *env != NULL ; ++env) {
+		limit -= strlen(*env) + 1 + sizeof(char *) ;
+	}
+	// Same headroom as xargs. //
+	limit -= 2048 ;
+
+	// Command name and leading options are repeated in every chunk. //
+	std::vector<std::string> prefix ;
+	long prefixSize = 0 ;
+	unsigned int i = start ;
+	do {
+		prefix.push_back(cmd[i]) ;
+		prefixSize += cmd[i].size() + 1 + sizeof(char *) ;
+		++i ;
+	} while (i < cmd.size() && cmd[i][0] == '-') ;
+
+	std::vector<std::vector<std::string>> chunks ;
+	std::vector<std::string> chunk = prefix ;
+	long chunkSize = prefixSize ;
+	for ( ; i < cmd.size() ; ++i) {
+		long argSize = cmd[i].size() + 1 + sizeof(char *) ;
+		if (chunk.size() > prefix.size() && chunkSize + argSize > limit) {
+			chunks.push_back(chunk) ;
+			chunk = prefix ;
+			chunkSize = prefixSize ;
+		}
+		chunk.push_back(cmd[i]) ;
+		chunkSize += argSize ;
+	}
+	chunks.push_back(chunk) ;
+
+	int exitStatus = EXIT_SUCCESS ;
+	unsigned int running = 0 ;
+	int status ;
+	for (unsigned int j = 0 ; j < chunks.size() ; ++j) {
+		if (running == parallel) {
+			pid_t reaped = wait(&status) ;
+			if (reaped > 0) {
+				Trace::wait(reaped, status) ;
+				int code = WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE ;
+				exitStatus = std::max(exitStatus, code) ;
+				--running ;
+			}
+		}
+		pid_t child_pid ;
+		uint64_t forkTime = Trace::now() ;
+		if ((child_pid = fork()) < 0) {
+			printf("*** ERROR: forking child process failed\n");
+			exit(1);
+		} else if (child_pid == 0) {
+			execCommand(chunks[j]) ;
+		}
+		Trace::fork(child_pid, forkTime) ;
+		++running ;
+	}
+	pid_t reaped ;
+	while (running > 0 && (reaped = wait(&status)) > 0) {
+		Trace::wait(reaped, status) ;
+		int code = WIFEXITED(status) ? WEXITSTATUS(status) : EXIT_FAILURE ;
+		exitStatus = std::max(exitStatus, code) ;
+		--running ;
+	}
+	exit(exitStatus) ;
+}		/* -----  end of member function runBatched  ----- */
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  parseList
+ *    Arguments:  const std::string & list - List such as "0-3,8,10-11".
+ *                int limit - Ids must be below this.
+ *                std::vector<int> & ids - Filled with the ids in the list.
+ *      Returns:  True if the list is well formed and every id is below limit.
+ * =====================================================================================
+ */
+
+static bool parseList(const std::string & list, int limit, std::vector<int> & ids) {
+	ids.clear() ;
+	size_t pos = 0 ;
+	while (pos < list.size()) {
+		size_t end = list.find(',', pos) ;
+		if (end == std::string::npos) {
+			end = list.size() ;
+		}
+		std::string range = list.substr(pos, end-pos) ;
+		size_t dash = range.find('-') ;
+		std::string lowStr = range.substr(0, dash) ;
+		std::string highStr = (dash == std::string::npos) ? lowStr : range.substr(dash+1) ;
+		if (lowStr.empty() || highStr.empty() ||
+				lowStr.find_first_not_of("0123456789") != std::string::npos ||
+				highStr.find_first_not_of("0123456789") != std::string::npos) {
+			return false ;
+		}
+		// Reject before atoi can overflow or the loop below run away. //
+		if (lowStr.size() > 9 || highStr.size() > 9) {
+			return false ;
+		}
+		int low = atoi(lowStr.c_str()) ;
+		int high = atoi(highStr.c_str()) ;
+		if (high < low || high >= limit) {
+			return false ;
+		}
+		for (int id = low ; id <= high ; ++id) {
+			ids.push_back(id) ;
+		}
+		pos = end + 1 ;
+	}
+	return !ids.empty() ;
+}		/* -----  end of function parseList  ----- */
+
+/*
+ * ===  FUNCTION  ======================================================================
+ *         Name:  isUnsigned
+ *    Arguments:  const std::string & str
+ *      Returns:  True if str is an unsigned integer, optionally with a leading '+'.
+ * =====================================================================================
+ */
+
+static bool isUnsigned(const std::string & str) {
+	size_t start = (str.size() > 1 && str[0] == '+') ? 1 : 0 ;
+	return !str.empty() && str.find_first_not_of("0123456789", start) == std::string::npos ;
+}		/* -----  end of function isUnsigned  ----- */
+
+/*
+ * ===  MEMBER FUNCTION CLASS : Shell  =================================================
+ *         Name:  applyTuning
+ *    Arguments:  const std::vector<std::string> & cmd - Command possibly starting with
+ *                a scheduling prefix.
+ *      Returns:  The number of words used by the prefix, 0 if cmd does not start with
+ *                one.
+ *  Description:  Applies one scheduling prefix to the current process. Called in the
+ *                child between fork and exec so no taskset/numactl processes are
+ *                needed. Prefixes chain, e.g. "pin 0-7 nice 5 sched batch cmd".
+ *                  pin CPUS                  - cpu affinity, e.g. 0-3,8.
+ *                  nice N|+N                 - add N to the nice value.
+ *                  ionice idle|be:N|rt:N     - io scheduling class and level.
+ *                  sched other|batch|idle    - scheduling policy.
+ *                  numa bind|interleave|preferred NODES - memory policy.
+ *                A prefix with a malformed argument, including a bad or out of range
+ *                cpu or node list, is not treated as a prefix so e.g. "nice -n 5 cmd"
+ *                and "pin -t tool.so -- app" still run the real binaries.
+ * =====================================================================================
+ */
+
+unsigned int Shell::applyTuning(const std::vector<std::string> & cmd) {
+	if (cmd.size() < 3) {
+		return 0 ;
+	}
+	const std::string & name = cmd[0] ;
+	const std::string & arg = cmd[1] ;
+	std::vector<int> ids ;
+
+	if (name.compare("pin") == 0) {
+		if (!parseList(arg, CPU_SETSIZE, ids)) {
+			return 0 ;
+		}
+		cpu_set_t cpus ;
+		CPU_ZERO(&cpus) ;
+		for (unsigned int i = 0 ; i < ids.size() ; ++i) {
+			CPU_SET(ids[i], &cpus) ;
+		}
+		if (sched_setaffinity(0, sizeof(cpus), &cpus) == -1) {
+			std::cerr << "Error cannot pin to cpus " << arg << ": " << strerror(errno) << std::endl ;
+			exit(EXIT_FAILURE) ;
+		}
+		pinned = true ;
+		return 2 ;
+	} else if (name.compare("nice") == 0 && isUnsigned(arg)) {
+		errno = 0 ;
+		if (nice(atoi(arg.c_str())) == -1 && errno != 0) {
+			std::cerr << "Error cannot set nice " << arg << ": " << strerror(errno) << std::endl ;
+			exit(EXIT_FAILURE) ;
+		}
+		return 2 ;
+	} else if (name.compare("ionice") == 0) {
+		// Values from linux/ioprio.h. //
+		const int classShift = 13 ;
+		const int whoProcess = 1 ;
+		int ioClass ;
+		int level = 4 ;
+		std::string classStr = arg.substr(0, arg.find(':')) ;
+		if (arg.find(':') != std::string::npos) {
+			std::string levelStr = arg.substr(arg.find(':')+1) ;
+			if (!isUnsigned(levelStr)) {
+				return 0 ;
+			}
+			level = atoi(levelStr.c_str()) ;
+		}
+		if (classStr.compare("rt") == 0) {
+			ioClass = 1 ;
+		} else if (classStr.compare("be") == 0) {
+			ioClass = 2 ;
+		} else if (classStr.compare("idle") == 0) {
+			ioClass = 3 ;
+			level = 0 ;
+		} else {
+			return 0 ;
+		}
+		if (syscall(SYS_ioprio_set, whoProcess, 0, (ioClass << classShift) | level) == -1) {
+			std::cerr << "Error cannot set ionice " << arg << ": " << strerror(errno) << std::endl ;
+			exit(EXIT_FAILURE) ;
+		}
+		return 2 ;
+	} else if (name.compare("sched") == 0) {
+		int policy ;
+		if (arg.compare("other") == 0) {
+			policy = SCHED_OTHER ;
+		} else if (arg.compare("batch") == 0) {
+			policy = SCHED_BATCH ;
+		} else if (arg.compare("idle") == 0) {
+			policy = SCHED_IDLE ;
+		} else {
+			return 0 ;
+		}
+		struct sched_param param ;
+		param.sched_priority = 0 ;
+		if (sched_setscheduler(0, policy, &param) == -1) {
+			std::cerr << "Error cannot set scheduler " << arg << ": " << strerror(errno) << std::endl ;
+			exit(EXIT_FAILURE) ;
+		}
+		return 2 ;
+	} else if (name.compare("numa") == 0 && cmd.size() > 3) {
+		int mode ;
+		if (arg.compare("bind") == 0) {
+			mode = MPOL_BIND ;
+		} else if (arg.compare("interleave") == 0) {
+			mode = MPOL_INTERLEAVE ;
+		} else if (arg.compare("preferred") == 0) {
+			mode = MPOL_PREFERRED ;
+		} else {
+			return 0 ;
+		}
+		const unsigned int bitsPerWord = sizeof(unsigned long) * 8 ;
+		std::vector<unsigned long> nodes(16, 0) ;
+		if (!parseList(cmd[2], nodes.size() * bitsPerWord, ids)) {
+			return 0 ;
+		}
+		for (unsigned int i = 0 ; i < ids.size() ; ++i) {
+			nodes[ids[i] / bitsPerWord] |= 1UL << (ids[i] % bitsPerWord) ;
+		}
+		if (syscall(SYS_set_mempolicy, mode, nodes.data(), nodes.size() * bitsPerWord) == -1) {
+			std::cerr << "Error cannot set numa policy " << arg << " " << cmd[2] << ": " <<
+				strerror(errno) << std::endl ;
+			exit(EXIT_FAILURE) ;
+		}
+		return 3 ;
+	}
+	return 0 ;
+}		/* -----  end of member function applyTuning  ----- */
+
+/*
+ * ===  MEMBER FUNCTION CLASS : Shell  =================================================
+ *         Name:  pinStage
+ *  Description:  Pins this pipeline stage to one of the cpus it may run on, chosen by
+ *                its position in the pipeline offset by the job's spreadBase so that
+ *                stages, and the stages of concurrent pipelines, land on distinct
+ *                cores where there are enough of them. This only pays off because
+ *                handlePipe starts every stage before waiting on any of them.
+ * =====================================================================================
+ */
+
+void Shell::pinStage() {
+	cpu_set_t allowed ;
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1) {
+		return ;
+	}
+	std::vector<int> cpus ;
+	for (int cpu = 0 ; cpu < CPU_SETSIZE ; ++cpu) {
+		if (CPU_ISSET(cpu, &allowed)) {
+			cpus.push_back(cpu) ;
+		}
+	}
+	if (cpus.size() < 2) {
+		return ;
+	}
+	cpu_set_t stageCpu ;
+	CPU_ZERO(&stageCpu) ;
+	CPU_SET(cpus[(spreadBase + pipeStage) % cpus.size()], &stageCpu) ;
+	sched_setaffinity(0, sizeof(stageCpu), &stageCpu) ;
+}		/* -----  end of member function pinStage  ----- */
+
+/*
+ * ===  MEMBER FUNCTION CLASS : Shell  =================================================
+ *         Name:  setOption
+ *    Arguments:  const std::vector<std::string> & args - "set -o|+o option".
+ *  Description:  Turns shell options on (-o) or off (+o). Options are:
+ *                  spread - pin each stage of a pipeline to a distinct cpu.
+ * =====================================================================================
+ */
+
+void Shell::setOption(const std::vector<std::string> & args) {
+	if (args.size() != 3 || (args[1].compare("-o") != 0 && args[1].compare("+o") != 0)) {
+		std::cerr << "Usage: set -o|+o option" << std::endl ;
+		return ;
+	}
+	bool enable = (args[1].compare("-o") == 0) ;
+	if (args[2].compare("spread") == 0) {
+		spreadStages = enable ;
+	} else {
+		std::cerr << "Error unknown option " << args[2] << std::endl ;
+	}
+}		/* -----  end of member function setOption  ----- */
+
 /* 
  * ===  MEMBER FUNCTION CLASS : Shell  =================================================
  *         Name:  handlePipe
  *    Arguments:  std::vector<std::vector<std::string>> & cmds - The remaining commands.
- *  Description:  Spawns a child process, waits for input while the child executes.
+ *  Description:  Spawns a child for each side of the pipe so both run at the same time,
+ *                then waits for both and exits with the status of the reader.
  * =====================================================================================
  */
 
 void Shell::handlePipe(std::vector<std::vector<std::string>> & cmds) {
 	int fd[2] ;
-	pid_t child_pid ;
+	pid_t writer_pid ;
+	pid_t reader_pid ;
 	int status ;
 	pipe(fd) ;
 
-	if ((child_pid = fork()) < 0) {
+	uint64_t forkTime = Trace::now() ;
+	if ((writer_pid = fork()) < 0) {
 		printf("*** ERROR: forking child process failed\n");
 		exit(1);
-	} else if (child_pid == 0) {
-		std::vector<std::string> currentCmd = cmds[cmds.size()-1] ; 
+	} else if (writer_pid == 0) {
 		cmds.pop_back() ;
+		++pipeStage ;
+		inPipeline = true ;
 		while ((dup2(fd[1], STDOUT_FILENO) == -1) && (errno == EINTR)) {} ;
+		Trace::fd(STDOUT_FILENO, "pipe") ;
 		close(fd[1]); // close read
 		close(fd[0]); // close read
 		runCommand(cmds) ;
-	} else {
+	}
+	Trace::fork(writer_pid, forkTime) ;
+
+	forkTime = Trace::now() ;
+	if ((reader_pid = fork()) < 0) {
+		printf("*** ERROR: forking child process failed\n");
+		exit(1);
+	} else if (reader_pid == 0) {
+		inPipeline = true ;
 		while ((dup2(fd[0], STDIN_FILENO) == -1) && (errno == EINTR)) {} ;
+		Trace::fd(STDIN_FILENO, "pipe") ;
 		close(fd[0]) ;
 		close(fd[1]) ; // close write
-		while(wait(&status) != child_pid) {
-			;
-		}
 		runCommand(cmds) ;
 	}
+	Trace::fork(reader_pid, forkTime) ;
+	close(fd[0]) ;
+	close(fd[1]) ;
+
+	int readerStatus = 0 ;
+	for (int remaining = 2 ; remaining > 0 ; ) {
+		pid_t pid = wait(&status) ;
+		if (pid == -1) {
+			if (errno == EINTR) {
+				continue ;
+			}
+			break ;
+		}
+		Trace::wait(pid, status) ;
+		if (pid == reader_pid) {
+			readerStatus = status ;
+			--remaining ;
+		} else if (pid == writer_pid) {
+			--remaining ;
+		}
+	}
+	if (WIFSIGNALED(readerStatus)) {
+		exit(128 + WTERMSIG(readerStatus)) ;
+	}
+	exit(WEXITSTATUS(readerStatus)) ;
 }		/* -----  end of member function handlePipe  ----- */
 
 
@@ -249,6 +1001,7 @@ void Shell::handleOverwrite(std::vector<std::vector<std::string>> & cmds, int de
 	int out = open(currentCmd[0].c_str(), O_WRONLY | O_TRUNC | O_CREAT, S_IRUSR | 
 			S_IRGRP | S_IWGRP | S_IWUSR) ;
 	dup2(out, dest) ;
+	Trace::fd(dest, "> " + currentCmd[0]) ;
 	runCommand(cmds) ;
 }		/* -----  end of member function handleOverwrite  ----- */
 
@@ -265,6 +1018,7 @@ void Shell::handleInput(std::vector<std::vector<std::string>> & cmds) {
 	cmds.pop_back() ;
 	int in = open(currentCmd[0].c_str(), O_RDONLY) ;
 	dup2(in, STDIN_FILENO) ;
+	Trace::fd(STDIN_FILENO, "< " + currentCmd[0]) ;
 	runCommand(cmds) ;
 }		/* -----  end of member function handleInput  ----- */
 
@@ -283,6 +1037,7 @@ void Shell::handleAppend(std::vector<std::vector<std::string>> & cmds, int dest)
 	int out = open(currentCmd[0].c_str(), O_WRONLY | O_APPEND | O_CREAT, S_IRUSR | 
 			S_IRGRP | S_IWGRP | S_IWUSR) ;
 	dup2(out, dest) ;
+	Trace::fd(dest, ">> " + currentCmd[0]) ;
 	runCommand(cmds) ;
 }		/* -----  end of member function handleAppend  ----- */
 
@@ -297,13 +1052,16 @@ void Shell::handleAppend(std::vector<std::vector<std::string>> & cmds, int dest)
 
 void Shell::handleBackground(std::vector<std::vector<std::string>> & cmds) {	
 	pid_t child_pid ;
+	uint64_t forkTime = Trace::now() ;
 	if ((child_pid = fork()) < 0) {
 		printf("*** ERROR: forking child process failed\\n");
 		exit(1);
 	} else if (child_pid == 0) {
 		pid_t gid = setpgid(child_pid, 0) ;
+		restoreSignals() ;
 		runCommand(cmds) ;
 	} else {
+		Trace::fork(child_pid, forkTime) ;
 		backgroundCommands.push_back(Parser::convertCmdsToString(cmds)) ;
 		backgroundCommandsPIDs.push_back(child_pid) ;
 		if (backgroundCommandsIDs.size() != 0) {
@@ -36,6 +36,20 @@
  *                  in the background due to this shell.
  *               std::vector<std::string> - backgroundCommandsIDs - The commands shell ids
  *                  running in the background due to this shell.
+ *               bool spreadStages - Pin each pipeline stage to its own cpu (set -o spread).
+ *               unsigned int pipeStage - Position of this process in its pipeline,
+ *                  counted from the right. Only differs from 0 in forked stages.
+ *               bool pinned - True once a pin prefix has set this process's cpus.
+ *               bool inPipeline - True in the processes of a multi-stage pipeline.
+ *               unsigned int spreadBase - First cpu index given to this job's stages.
+ *               unsigned int spreadNext - First cpu index for the next job, advanced
+ *                  by the number of stages of every job started.
+ *               std::string promptSegment - Git branch shown in the prompt.
+ *               pid_t segmentPID - Pid of the helper computing promptSegment, -1 if none.
+ *               std::string segmentOutput - Output read so far from the helper.
+ *               std::string segmentDirectory - Directory the helper last ran in.
+ *               int epollFD, signalFD, timerFD, segmentFD - Descriptors multiplexed
+ *                  by the main loop.
  *  Description:  Shell class that prompts for input, handles command execution and
  *                keeps track of spawned processes.
  *  =====================================================================================
@@ -44,9 +58,11 @@
 class Shell {
  public:
 	Shell() ;
+	void run() ;
 	std::string prompt() ;
 	void execute(std::string) ;
-	void checkBackgrounds() ;
+	std::string checkBackgrounds() ;
+	std::string waitBackgrounds() ;
 	void displayShellName() ;
 	virtual ~Shell() ;
  private:
@@ -60,8 +76,36 @@ class Shell {
 	std::vector<std::string> backgroundCommands ;
 	std::vector<int> backgroundCommandsIDs ;
 	std::vector<pid_t> backgroundCommandsPIDs ;
+	bool spreadStages ;
+	unsigned int pipeStage ;
+	bool pinned ;
+	bool inPipeline ;
+	unsigned int spreadBase ;
+	unsigned int spreadNext ;
+	std::string promptSegment ;
+	pid_t segmentPID ;
+	std::string segmentOutput ;
+	std::string segmentDirectory ;
+	int epollFD ;
+	int signalFD ;
+	int timerFD ;
+	int segmentFD ;
+	static Shell * activeShell ;
  private:
+	static void lineHandler(char * line) ;
+	void handleLine(char * line) ;
+	std::string promptString() ;
+	void printAbovePrompt(const std::string & text) ;
+	bool watch(int fd) ;
+	void refreshSegment() ;
+	void readSegment() ;
+	void armSegmentTimer(bool enable) ;
 	void runCommand(std::vector<std::vector<std::string>> & cmds) ;
+	void execCommand(const std::vector<std::string> & cmd) ;
+	void runBatched(std::vector<std::string> & cmd) ;
+	unsigned int applyTuning(const std::vector<std::string> & cmd) ;
+	void pinStage() ;
+	void setOption(const std::vector<std::string> & args) ;
 	void handlePipe(std::vector<std::vector<std::string>> & cmds) ;
 	void handleOverwrite(std::vector<std::vector<std::string>> & cmds, int dest) ;
 	void handleInput(std::vector<std::vector<std::string>> & cmds) ;
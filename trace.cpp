@@ -0,0 +1,611 @@
+/*
+ * =====================================================================================
+ *
+ *       Filename:  trace.cpp
+ *
+ *    Description:  Source for Trace object.
+ *
+ *        Version:  1.0
+ *        Created:  19/10/26 14:31:05
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Michael Tierney (MT), tiernemi@tcd.ie
+ *
+ * =====================================================================================
+ */
+
+#include "trace.hpp"
+#include "parser.hpp"
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <iomanip>
+#include <map>
+#include <algorithm>
+
+// File starts with the magic followed by a uint32 version. //
+static const char traceMagic[8] = {'U', 'S', 'H', 'T', 'R', 'A', 'C', 'E'} ;
+static const uint32_t traceVersion = 1 ;
+// Record header: uint32 payload length, uint16 type, int32 pid, uint64 time. //
+static const size_t headerSize = 18 ;
+
+int Trace::traceFD = -1 ;
+
+/*
+ * =====================================================================================
+ *  Encoding. Integers are stored in host byte order, strings as a uint32 length and
+ *  the bytes, lists as a uint32 count and their elements.
+ * =====================================================================================
+ */
+
+template <typename T>
+static void put(std::string & out, T value) {
+	out.append(reinterpret_cast<const char *>(&value), sizeof(value)) ;
+}
+
+static void putString(std::string & out, const std::string & str) {
+	put<uint32_t>(out, str.size()) ;
+	out += str ;
+}
+
+static void putList(std::string & out, const std::vector<std::string> & list) {
+	put<uint32_t>(out, list.size()) ;
+	for (unsigned int i = 0 ; i < list.size() ; ++i) {
+		putString(out, list[i]) ;
+	}
+}
+
+template <typename T>
+static bool get(const std::string & in, size_t & pos, T & value) {
+	if (pos + sizeof(value) > in.size()) {
+		return false ;
+	}
+	memcpy(&value, in.data() + pos, sizeof(value)) ;
+	pos += sizeof(value) ;
+	return true ;
+}
+
+static bool getString(const std::string & in, size_t & pos, std::string & str) {
+	uint32_t len ;
+	if (!get(in, pos, len) || pos + len > in.size()) {
+		return false ;
+	}
+	str.assign(in, pos, len) ;
+	pos += len ;
+	return true ;
+}
+
+static bool getList(const std::string & in, size_t & pos, std::vector<std::string> & list) {
+	uint32_t count ;
+	if (!get(in, pos, count)) {
+		return false ;
+	}
+	list.resize(count) ;
+	for (uint32_t i = 0 ; i < count ; ++i) {
+		if (!getString(in, pos, list[i])) {
+			return false ;
+		}
+	}
+	return true ;
+}
+
+// Exit code of a wait status, 128 + signal for killed processes like other shells. //
+static int exitCode(int status) {
+	if (WIFEXITED(status)) {
+		return WEXITSTATUS(status) ;
+	} else if (WIFSIGNALED(status)) {
+		return 128 + WTERMSIG(status) ;
+	}
+	return -1 ;
+}
+
+static std::string joinArgs(const std::vector<std::string> & args) {
+	std::string joined ;
+	for (unsigned int i = 0 ; i < args.size() ; ++i) {
+		joined += (i == 0) ? args[i] : " " + args[i] ;
+	}
+	return joined ;
+}
+
+static bool earlier(const TraceEvent & a, const TraceEvent & b) {
+	return a.time < b.time ;
+}
+
+// Length of the valid UTF-8 sequence starting at str[pos], 0 if it is invalid. //
+static size_t utf8Length(const std::string & str, size_t pos) {
+	unsigned char lead = str[pos] ;
+	size_t len ;
+	unsigned char low = 0x80 ;
+	unsigned char high = 0xBF ;
+	if (lead >= 0xC2 && lead <= 0xDF) {
+		len = 2 ;
+	} else if (lead >= 0xE0 && lead <= 0xEF) {
+		len = 3 ;
+		// No overlong forms or surrogates. //
+		low = (lead == 0xE0) ? 0xA0 : 0x80 ;
+		high = (lead == 0xED) ? 0x9F : 0xBF ;
+	} else if (lead >= 0xF0 && lead <= 0xF4) {
+		len = 4 ;
+		// No overlong forms or code points past U+10FFFF. //
+		low = (lead == 0xF0) ? 0x90 : 0x80 ;
+		high = (lead == 0xF4) ? 0x8F : 0xBF ;
+	} else {
+		return 0 ;
+	}
+	if (pos + len > str.size()) {
+		return 0 ;
+	}
+	for (size_t i = 1 ; i < len ; ++i) {
+		unsigned char c = str[pos+i] ;
+		if (c < ((i == 1) ? low : 0x80) || c > ((i == 1) ? high : 0xBF)) {
+			return 0 ;
+		}
+	}
+	return len ;
+}
+
+// Escapes str for a JSON string. Bytes that are not valid UTF-8 become U+FFFD. //
+static std::string jsonEscape(const std::string & str) {
+	std::string escaped ;
+	for (unsigned int i = 0 ; i < str.size() ; ++i) {
+		unsigned char c = str[i] ;
+		if (c >= 0x80) {
+			size_t len = utf8Length(str, i) ;
+			if (len == 0) {
+				escaped += "\\ufffd" ;
+			} else {
+				escaped.append(str, i, len) ;
+				i += len - 1 ;
+			}
+		} else if (c == '"' || c == '\\') {
+			escaped += '\\' ;
+			escaped += c ;
+		} else if (c < 0x20) {
+			char buf[8] ;
+			snprintf(buf, sizeof(buf), "\\u%04x", c) ;
+			escaped += buf ;
+		} else {
+			escaped += c ;
+		}
+	}
+	return escaped ;
+}
+
+/*
+ * ===  MEMBER FUNCTION CLASS : Trace  ================================================
+ *         Name:  open
+ *    Arguments:  const std::string & path - File to record to. Truncated if it exists.
+ *      Returns:  True if recording was started.
+ * =====================================================================================
+ */
+
+bool Trace::open(const std::string & path) {
+	traceFD = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC,
+			S_IRUSR | S_IWUSR | S_IRGRP) ;
+	if (traceFD < 0) {
+		return false ;
+	}
+	std::string header(traceMagic, sizeof(traceMagic)) ;
+	put<uint32_t>(header, traceVersion) ;
+	if (write(traceFD, header.data(), header.size()) != static_cast<ssize_t>(header.size())) {
+		close(traceFD) ;
+		traceFD = -1 ;
+		return false ;
+	}
+	return true ;
+}		/* -----  end of member function open  ----- */
+
+/*
+ * ===  MEMBER FUNCTION CLASS : Trace  ================================================
+ *         Name:  enabled
+ *      Returns:  True if a trace is being recorded.
+ * =====================================================================================
+ */
+
+bool Trace::enabled() {
+	return traceFD >= 0 ;
+}		/* -----  end of member function enabled  ----- */
+
+/*
+ * ===  MEMBER FUNCTION CLASS : Trace  ================================================
+ *         Name:  now
+ *      Returns:  CLOCK_MONOTONIC time in nanoseconds, the clock used for records.
+ * =====================================================================================
+ */
+
+uint64_t Trace::now() {
+	struct timespec ts ;
+	clock_gettime(CLOCK_MONOTONIC, &ts) ;
+	return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec ;
+}		/* -----  end of member function now  ----- */
+
+/*
+ * ===  MEMBER FUNCTION CLASS : Trace  ================================================
+ *         Name:  record
+ *    Arguments:  Type type - Record type.
+ *                const std::string & payload - Encoded payload.
+ *                uint64_t time - Timestamp of the event, 0 for now.
+ *  Description:  Writes one record. The whole record goes out in one write so records
+ *                from different processes never interleave.
+ * =====================================================================================
+ */
+
+void Trace::record(Type type, const std::string & payload, uint64_t time) {
+	std::string out ;
+	out.reserve(headerSize + payload.size()) ;
+	put<uint32_t>(out, payload.size()) ;
+	put<uint16_t>(out, type) ;
+	put<int32_t>(out, getpid()) ;
+	put<uint64_t>(out, (time != 0) ? time : now()) ;
+	out += payload ;
+	int savedErrno = errno ;
+	while (write(traceFD, out.data(), out.size()) == -1 && errno == EINTR) {} ;
+	errno = savedErrno ;
+}		/* -----  end of member function record  ----- */
+
+/*
+ * ===  MEMBER FUNCTION CLASS : Trace  ================================================
+ *         Name:  line, group, groupEnd, fork, exec, execError, wait, fd
+ *  Description:  Record the matching event if tracing is enabled. See Trace::Type.
+ * =====================================================================================
+ */
+
+void Trace::line(const std::string & cmd) {
+	if (enabled()) {
+		std::string payload ;
+		putString(payload, cmd) ;
+		record(LINE, payload) ;
+	}
+}		/* -----  end of member function line  ----- */
+
+void Trace::group(Type type, const std::vector<std::vector<std::string>> & cmds) {
+	if (enabled()) {
+		std::string payload ;
+		put<uint32_t>(payload, cmds.size()) ;
+		for (unsigned int i = 0 ; i < cmds.size() ; ++i) {
+			putList(payload, cmds[i]) ;
+		}
+		record(type, payload) ;
+	}
+}		/* -----  end of member function group  ----- */
+
+void Trace::groupEnd() {
+	if (enabled()) {
+		record(GROUP_END, "") ;
+	}
+}		/* -----  end of member function groupEnd  ----- */
+
+void Trace::fork(pid_t child, uint64_t started) {
+	if (enabled() && child > 0) {
+		std::string payload ;
+		put<int32_t>(payload, child) ;
+		record(FORK, payload, started) ;
+	}
+}		/* -----  end of member function fork  ----- */
+
+void Trace::exec(const std::vector<std::string> & args, bool builtin) {
+	if (enabled()) {
+		std::string payload ;
+		putList(payload, args) ;
+		record(builtin ? BUILTIN : EXEC, payload) ;
+	}
+}		/* -----  end of member function exec  ----- */
+
+void Trace::execError(int err) {
+	if (enabled()) {
+		std::string payload ;
+		put<int32_t>(payload, err) ;
+		record(EXEC_ERROR, payload) ;
+	}
+}		/* -----  end of member function execError  ----- */
+
+void Trace::wait(pid_t pid, int status) {
+	if (enabled() && pid > 0) {
+		std::string payload ;
+		put<int32_t>(payload, pid) ;
+		put<int32_t>(payload, status) ;
+		record(WAIT, payload) ;
+	}
+}		/* -----  end of member function wait  ----- */
+
+void Trace::fd(int fd, const std::string & target) {
+	if (enabled()) {
+		std::string payload ;
+		put<int32_t>(payload, fd) ;
+		putString(payload, target) ;
+		record(FD, payload) ;
+	}
+}		/* -----  end of member function fd  ----- */
+
+/*
+ * ===  MEMBER FUNCTION CLASS : Trace  ================================================
+ *         Name:  load
+ *    Arguments:  const std::string & path - Trace file.
+ *                std::vector<TraceEvent> & events - Filled with the decoded records.
+ *      Returns:  True if the file is a trace. A truncated last record is dropped.
+ *                Events are returned in time order.
+ * =====================================================================================
+ */
+
+bool Trace::load(const std::string & path, std::vector<TraceEvent> & events) {
+	std::ifstream file(path.c_str(), std::ios::binary) ;
+	if (!file) {
+		return false ;
+	}
+	std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>()) ;
+	size_t pos = sizeof(traceMagic) ;
+	uint32_t version ;
+	if (data.compare(0, sizeof(traceMagic), traceMagic, sizeof(traceMagic)) != 0 ||
+			!get(data, pos, version) || version != traceVersion) {
+		return false ;
+	}
+
+	events.clear() ;
+	while (pos + headerSize <= data.size()) {
+		uint32_t length ;
+		int32_t pid ;
+		TraceEvent event ;
+		if (!get(data, pos, length) || !get(data, pos, event.type) || !get(data, pos, pid) ||
+				!get(data, pos, event.time) || pos + length > data.size()) {
+			break ;
+		}
+		event.pid = pid ;
+		event.first = 0 ;
+		event.second = 0 ;
+		std::string payload = data.substr(pos, length) ;
+		pos += length ;
+
+		size_t at = 0 ;
+		bool ok = true ;
+		switch (event.type) {
+			case LINE :
+				ok = getString(payload, at, event.text) ;
+				break ;
+			case PARSE :
+			case EXPAND : {
+				uint32_t count ;
+				ok = get(payload, at, count) ;
+				event.group.resize(ok ? count : 0) ;
+				for (uint32_t i = 0 ; ok && i < count ; ++i) {
+					ok = getList(payload, at, event.group[i]) ;
+				}
+				break ;
+			}
+			case FORK :
+			case EXEC_ERROR :
+				ok = get(payload, at, event.first) ;
+				break ;
+			case EXEC :
+			case BUILTIN :
+				ok = getList(payload, at, event.args) ;
+				break ;
+			case WAIT :
+				ok = get(payload, at, event.first) && get(payload, at, event.second) ;
+				break ;
+			case FD :
+				ok = get(payload, at, event.first) && getString(payload, at, event.text) ;
+				break ;
+			default :
+				break ;
+		}
+		if (ok) {
+			events.push_back(event) ;
+		}
+	}
+	// Fork records are written after the fork but stamped before it. //
+	std::stable_sort(events.begin(), events.end(), earlier) ;
+	return true ;
+}		/* -----  end of member function load  ----- */
+
+/*
+ * ===  MEMBER FUNCTION CLASS : Trace  ================================================
+ *         Name:  commandLines
+ *    Arguments:  const std::string & path - Trace file.
+ *                std::vector<std::string> & lines - Filled with the recorded lines.
+ *      Returns:  True if the file is a trace.
+ *  Description:  Used by --replay to execute the session again.
+ * =====================================================================================
+ */
+
+bool Trace::commandLines(const std::string & path, std::vector<std::string> & lines) {
+	std::vector<TraceEvent> events ;
+	if (!load(path, events)) {
+		return false ;
+	}
+	lines.clear() ;
+	for (unsigned int i = 0 ; i < events.size() ; ++i) {
+		if (events[i].type == LINE) {
+			lines.push_back(events[i].text) ;
+		}
+	}
+	return true ;
+}		/* -----  end of member function commandLines  ----- */
+
+/*
+ * ===  MEMBER FUNCTION CLASS : Trace  ================================================
+ *         Name:  simulate
+ *    Arguments:  const std::string & path - Trace file.
+ *                std::ostream & out - Where to print the timeline.
+ *      Returns:  True if the file is a trace.
+ *  Description:  Prints every recorded event with its time since the start of the
+ *                trace, without running anything.
+ * =====================================================================================
+ */
+
+bool Trace::simulate(const std::string & path, std::ostream & out) {
+	std::vector<TraceEvent> events ;
+	if (!load(path, events)) {
+		return false ;
+	}
+	std::map<pid_t, uint64_t> forkTimes ;
+	for (unsigned int i = 0 ; i < events.size() ; ++i) {
+		const TraceEvent & event = events[i] ;
+		double ms = (event.time - events[0].time) / 1e6 ;
+		out << std::fixed << std::setprecision(3) << std::setw(12) << ms << " ms  [" <<
+			event.pid << "]  " ;
+		switch (event.type) {
+			case LINE :
+				out << "$ " << event.text ;
+				break ;
+			case PARSE :
+				out << "parse  " << Parser::convertCmdsToString(event.group) ;
+				break ;
+			case EXPAND :
+				out << "expand " << Parser::convertCmdsToString(event.group) ;
+				break ;
+			case GROUP_END :
+				out << "group done" ;
+				break ;
+			case FORK :
+				forkTimes[event.first] = event.time ;
+				out << "fork   " << event.first ;
+				break ;
+			case EXEC :
+				out << "exec   " << joinArgs(event.args) ;
+				break ;
+			case BUILTIN :
+				out << "builtin " << joinArgs(event.args) ;
+				break ;
+			case EXEC_ERROR :
+				out << "exec failed: " << strerror(event.first) ;
+				break ;
+			case WAIT :
+				out << "wait   " << event.first << " exit " << exitCode(event.second) ;
+				if (forkTimes.count(event.first)) {
+					out << " after " << (event.time - forkTimes[event.first]) / 1e6 << " ms" ;
+				}
+				break ;
+			case FD :
+				out << "fd " << event.first << " -> " << event.text ;
+				break ;
+			default :
+				out << "unknown record " << event.type ;
+				break ;
+		}
+		out << "\n" ;
+	}
+	return true ;
+}		/* -----  end of member function simulate  ----- */
+
+/*
+ * ===  MEMBER FUNCTION CLASS : Trace  ================================================
+ *         Name:  exportChrome
+ *    Arguments:  const std::string & path - Trace file.
+ *                std::ostream & out - Where to write the JSON.
+ *      Returns:  True if the file is a trace.
+ *  Description:  Writes the trace in the Chrome trace event format. Each process gets
+ *                its own row spanning fork to wait, named after the first command it
+ *                runs, so pipeline stages that overlap or wait on each other are
+ *                visible. Forks and waits are paired in one pass. Command groups are spans on the
+ *                shell's row, descriptor changes and exec failures are instants.
+ * =====================================================================================
+ */
+
+bool Trace::exportChrome(const std::string & path, std::ostream & out) {
+	std::vector<TraceEvent> events ;
+	if (!load(path, events)) {
+		return false ;
+	}
+	out << "{\"traceEvents\":[" ;
+	if (events.empty()) {
+		out << "]}\n" ;
+		return true ;
+	}
+	const pid_t shellPID = events[0].pid ;
+	const uint64_t start = events[0].time ;
+	const uint64_t end = events[events.size()-1].time ;
+	bool first = true ;
+
+	// Process spans are filled in as the events go by and written at the end. A pid //
+	// maps to its open fork until it is reaped, so reused pids start a new span. //
+	struct Span {
+		pid_t child ;
+		pid_t parent ;
+		uint64_t start ;
+		uint64_t finish ;
+		int code ;
+		std::string name ;
+	} ;
+	std::vector<Span> spans ;
+	std::map<pid_t, size_t> openForks ;
+
+	std::string groupName ;
+	uint64_t groupStart = 0 ;
+	for (unsigned int i = 0 ; i < events.size() ; ++i) {
+		const TraceEvent & event = events[i] ;
+		char ts[32] ;
+		snprintf(ts, sizeof(ts), "%.3f", (event.time - start) / 1e3) ;
+		std::string common = "\"pid\":" + std::to_string(shellPID) + ",\"tid\":" +
+			std::to_string(event.pid) + ",\"ts\":" + ts ;
+		std::string entry ;
+
+		if (event.type == PARSE) {
+			groupStart = event.time ;
+			groupName = Parser::convertCmdsToString(event.group) ;
+		} else if (event.type == EXPAND) {
+			groupName = Parser::convertCmdsToString(event.group) ;
+		} else if (event.type == GROUP_END && groupStart != 0) {
+			char startTs[32], dur[32] ;
+			snprintf(startTs, sizeof(startTs), "%.3f", (groupStart - start) / 1e3) ;
+			snprintf(dur, sizeof(dur), "%.3f", (event.time - groupStart) / 1e3) ;
+			entry = "{\"name\":\"" + jsonEscape(groupName) + "\",\"cat\":\"command\",\"ph\":\"X\"," +
+				"\"pid\":" + std::to_string(shellPID) + ",\"tid\":" + std::to_string(event.pid) +
+				",\"ts\":" + startTs + ",\"dur\":" + dur + "}" ;
+			groupStart = 0 ;
+		} else if (event.type == FORK) {
+			Span span = {event.first, event.pid, event.time, end, -1, ""} ;
+			openForks[event.first] = spans.size() ;
+			spans.push_back(span) ;
+		} else if (event.type == EXEC || event.type == BUILTIN) {
+			// The first command a child runs after its fork names its row. //
+			std::map<pid_t, size_t>::iterator open = openForks.find(event.pid) ;
+			if (open != openForks.end() && spans[open->second].name.empty()) {
+				spans[open->second].name = joinArgs(event.args) ;
+			}
+		} else if (event.type == WAIT) {
+			std::map<pid_t, size_t>::iterator open = openForks.find(event.first) ;
+			if (open != openForks.end()) {
+				spans[open->second].finish = event.time ;
+				spans[open->second].code = exitCode(event.second) ;
+				openForks.erase(open) ;
+			}
+		} else if (event.type == FD) {
+			entry = "{\"name\":\"" + jsonEscape("fd " + std::to_string(event.first) + " -> " +
+					event.text) + "\",\"cat\":\"fd\",\"ph\":\"i\",\"s\":\"t\"," + common + "}" ;
+		} else if (event.type == EXEC_ERROR) {
+			entry = "{\"name\":\"" + jsonEscape(std::string("exec failed: ") + strerror(event.first)) +
+				"\",\"cat\":\"exec\",\"ph\":\"i\",\"s\":\"t\"," + common + "}" ;
+		}
+
+		if (!entry.empty()) {
+			out << (first ? "\n" : ",\n") << entry ;
+			first = false ;
+		}
+	}
+
+	for (unsigned int i = 0 ; i < spans.size() ; ++i) {
+		const Span & span = spans[i] ;
+		std::string name = span.name.empty() ? "fork" : span.name ;
+		char ts[32], dur[32] ;
+		snprintf(ts, sizeof(ts), "%.3f", (span.start - start) / 1e3) ;
+		snprintf(dur, sizeof(dur), "%.3f", (span.finish - span.start) / 1e3) ;
+		out << (first ? "\n" : ",\n") ;
+		out << "{\"name\":\"" + jsonEscape(name) + "\",\"cat\":\"process\",\"ph\":\"X\"," +
+			"\"pid\":" + std::to_string(shellPID) + ",\"tid\":" + std::to_string(span.child) +
+			",\"ts\":" + ts + ",\"dur\":" + dur + ",\"args\":{\"parent\":" +
+			std::to_string(span.parent) + ",\"exit\":" + std::to_string(span.code) + "}}," +
+			"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + std::to_string(shellPID) +
+			",\"tid\":" + std::to_string(span.child) + ",\"args\":{\"name\":\"" +
+			jsonEscape(name + " (" + std::to_string(span.child) + ")") + "\"}}" ;
+		first = false ;
+	}
+	out << "\n]}\n" ;
+	return true ;
+}		/* -----  end of member function exportChrome  ----- */
@@ -0,0 +1,90 @@
+#ifndef TRACE_HPP_R7XW2LDC
+#define TRACE_HPP_R7XW2LDC
+
+/*
+ * =====================================================================================
+ *
+ *       Filename:  trace.hpp
+ *
+ *    Description:  Session trace recording, replay and export.
+ *
+ *        Version:  1.0
+ *        Created:  19/10/26 14:31:05
+ *       Revision:  none
+ *       Compiler:  g++
+ *
+ *         Author:  Michael Tierney (MT), tiernemi@tcd.ie
+ *
+ * =====================================================================================
+ */
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * ===  STRUCT  ========================================================================
+ *         Name:  TraceEvent
+ *  Description:  One decoded trace record. Which fields are used depends on type.
+ * =====================================================================================
+ */
+
+struct TraceEvent {
+	uint16_t type ;
+	pid_t pid ;
+	uint64_t time ;
+	int32_t first ;
+	int32_t second ;
+	std::string text ;
+	std::vector<std::string> args ;
+	std::vector<std::vector<std::string>> group ;
+} ;		/* -----  end of struct TraceEvent  ----- */
+
+/*
+ * ===  CLASS  =========================================================================
+ *         Name:  Trace
+ *  Description:  Helper class that records what the shell does to a binary log and
+ *                reads it back. Records are written with a single write to a file
+ *                opened with O_APPEND so forked children can log to the same file.
+ *                Every record holds the pid of the writer and a CLOCK_MONOTONIC
+ *                timestamp in nanoseconds.
+ * =====================================================================================
+ */
+
+class Trace {
+ public:
+	enum Type {
+		LINE = 1,       // text - Raw command line.
+		PARSE = 2,      // group - Group as parsed.
+		EXPAND = 3,     // group - Group after expansion.
+		GROUP_END = 4,  // Foreground group finished.
+		FORK = 5,       // first - Child pid. Timestamp is taken before the fork.
+		EXEC = 6,       // args - Argument vector about to be exec'd.
+		BUILTIN = 7,    // args - Argument vector run in process.
+		EXEC_ERROR = 8, // first - errno of the failed exec.
+		WAIT = 9,       // first - Reaped pid, second - Wait status.
+		FD = 10         // first - Descriptor replaced, text - What it now refers to.
+	} ;
+	static bool open(const std::string &) ;
+	static bool enabled() ;
+	static uint64_t now() ;
+	static void line(const std::string &) ;
+	static void group(Type, const std::vector<std::vector<std::string>> &) ;
+	static void groupEnd() ;
+	static void fork(pid_t, uint64_t) ;
+	static void exec(const std::vector<std::string> &, bool) ;
+	static void execError(int) ;
+	static void wait(pid_t, int) ;
+	static void fd(int, const std::string &) ;
+	static bool load(const std::string &, std::vector<TraceEvent> &) ;
+	static bool commandLines(const std::string &, std::vector<std::string> &) ;
+	static bool simulate(const std::string &, std::ostream &) ;
+	static bool exportChrome(const std::string &, std::ostream &) ;
+ private:
+	static int traceFD ;
+	static void record(Type, const std::string &, uint64_t = 0) ;
+} ;		/* -----  end of class Trace  ----- */
+
+#endif /* end of include guard: TRACE_HPP_R7XW2LDC */